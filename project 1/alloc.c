@@ -0,0 +1,132 @@
+#include "alloc.h"
+#include "inode.h"
+#include "diskimg.h"
+#include "iostats.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Blocks outside the data area can't be on the free list.
+static int bad_block(struct unixfilesystem *fs, int blockNum) {
+  if (blockNum < INODE_START_SECTOR + fs->superblock.s_isize || blockNum >= fs->superblock.s_fsize) {
+    fprintf(stderr, "Bad block %d on free list\n", blockNum);
+    return 1;
+  }
+  return 0;
+}
+
+int alloc_block(struct unixfilesystem *fs) {
+  struct filsys *sb = &fs->superblock;
+  int blockNum;
+  do {
+    if (sb->s_nfree == 0) goto nospace;
+    blockNum = sb->s_free[--sb->s_nfree];
+    if (blockNum == 0) goto nospace;
+  } while (bad_block(fs, blockNum));
+
+  char buf[DISKIMG_SECTOR_SIZE];
+  if (sb->s_nfree == 0) {
+    // blockNum holds the next part of the list; pull it into the superblock.
+    struct freeblock *fb = (struct freeblock *) buf;
+    if (iostats_readsector(fs, IOSITE_ALLOC_BLOCK, blockNum, buf) != DISKIMG_SECTOR_SIZE) return -1;
+    if (fb->nfree > NICFREE) {
+      fprintf(stderr, "Corrupt free list block %d\n", blockNum);
+      return -1;
+    }
+    sb->s_nfree = fb->nfree;
+    memcpy(sb->s_free, fb->free, sizeof(sb->s_free));
+  }
+  sb->s_fmod = 1;
+
+  memset(buf, 0, DISKIMG_SECTOR_SIZE);
+  if (iostats_writesector(fs, IOSITE_ALLOC_BLOCK, blockNum, buf) != DISKIMG_SECTOR_SIZE) return -1;
+  return blockNum;
+
+nospace:
+  // Leave the list empty rather than pointing at the terminating 0.
+  sb->s_nfree = 0;
+  sb->s_fmod = 1;
+  fprintf(stderr, "No space on device\n");
+  return -1;
+}
+
+int alloc_freeblock(struct unixfilesystem *fs, int blockNum) {
+  struct filsys *sb = &fs->superblock;
+  if (bad_block(fs, blockNum)) return -1;
+  if (sb->s_nfree == 0) {
+    sb->s_nfree = 1;
+    sb->s_free[0] = 0;
+  }
+  if (sb->s_nfree >= NICFREE) {
+    // The cache is full: spill it into the freed block, which becomes the link.
+    char buf[DISKIMG_SECTOR_SIZE];
+    memset(buf, 0, DISKIMG_SECTOR_SIZE);
+    struct freeblock *fb = (struct freeblock *) buf;
+    fb->nfree = sb->s_nfree;
+    memcpy(fb->free, sb->s_free, sizeof(fb->free));
+    if (iostats_writesector(fs, IOSITE_ALLOC_FREEBLOCK, blockNum, buf) != DISKIMG_SECTOR_SIZE) return -1;
+    sb->s_nfree = 0;
+  }
+  sb->s_free[sb->s_nfree++] = blockNum;
+  sb->s_fmod = 1;
+  return 0;
+}
+
+// Refills the free inode cache with up to NICINOD unallocated inodes from
+// the I list.  Returns -1 on a read error.
+static int scan_ilist(struct unixfilesystem *fs) {
+  struct filsys *sb = &fs->superblock;
+  int inodesPerSector = DISKIMG_SECTOR_SIZE / sizeof(struct inode);
+  int inumber = 0;
+  sb->s_ninode = 0;
+  for (int s = 0; s < sb->s_isize && sb->s_ninode < NICINOD; s++) {
+    struct inode buf[DISKIMG_SECTOR_SIZE / sizeof(struct inode)];
+    const struct inode *inodes = iostats_sectorref(fs, IOSITE_ALLOC_INODE, INODE_START_SECTOR + s, buf);
+    if (inodes == NULL) return -1;
+    for (int i = 0; i < inodesPerSector && sb->s_ninode < NICINOD; i++) {
+      inumber++;
+      if (!(inodes[i].i_mode & IALLOC)) sb->s_inode[sb->s_ninode++] = inumber;
+    }
+  }
+  sb->s_fmod = 1;
+  return 0;
+}
+
+int alloc_inode(struct unixfilesystem *fs, int mode) {
+  struct filsys *sb = &fs->superblock;
+  struct inode in;
+  for (;;) {
+    if (sb->s_ninode == 0) {
+      if (scan_ilist(fs) < 0) return -1;
+      if (sb->s_ninode == 0) {
+        fprintf(stderr, "Out of inodes\n");
+        return -1;
+      }
+    }
+    int inumber = sb->s_inode[--sb->s_ninode];
+    sb->s_fmod = 1;
+    if (inode_iget(fs, inumber, &in) < 0) return -1;
+    if (in.i_mode & IALLOC) continue;  // stale cache entry
+
+    uint32_t now = time(NULL);
+    memset(&in, 0, sizeof(in));
+    in.i_mode = mode | IALLOC;
+    in.i_nlink = 1;
+    in.i_atime[0] = in.i_mtime[0] = now >> 16;
+    in.i_atime[1] = in.i_mtime[1] = now & 0xffff;
+    if (inode_iput(fs, inumber, &in) < 0) return -1;
+    return inumber;
+  }
+}
+
+int alloc_freeinode(struct unixfilesystem *fs, int inumber) {
+  struct filsys *sb = &fs->superblock;
+  struct inode in;
+  memset(&in, 0, sizeof(in));
+  if (inode_iput(fs, inumber, &in) < 0) return -1;
+  if (sb->s_ninode < NICINOD) {
+    sb->s_inode[sb->s_ninode++] = inumber;
+    sb->s_fmod = 1;
+  }
+  return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef _ALLOC_H_
+#define _ALLOC_H_
+
+#include "unixfilesystem.h"
+
+/**
+ * Disk block and inode allocation, after alloc.c of Unix Version 6.
+ *
+ * Free blocks are kept in the superblock's s_free cache.  s_free[0] links to
+ * a block holding the next part of the list: its first word is a count and
+ * the next 100 words are free block numbers, the first of which links on in
+ * turn; a link of 0 ends the list.  Free inodes are cached in s_inode and
+ * the I list is rescanned when the cache runs dry.
+ *
+ * Changes to the superblock only set s_fmod; they reach the disk when
+ * unixfilesystem_sync() or unixfilesystem_free() is called.  None of the
+ * write functions are thread safe.
+ */
+
+#define NICFREE  100  // free block numbers held by the superblock or a list block
+#define NICINOD  100  // size of the superblock's free inode cache
+
+// Layout of a block continuing the free list.
+struct freeblock {
+  uint16_t nfree;
+  uint16_t free[NICFREE];
+};
+
+/**
+ * Allocates a free disk block and fills it with zeros.  Returns the block
+ * number, or -1 if the disk is full or on error.
+ */
+int alloc_block(struct unixfilesystem *fs);
+
+/**
+ * Returns block blockNum to the free list.  Returns 0 on success, -1 on error.
+ */
+int alloc_freeblock(struct unixfilesystem *fs, int blockNum);
+
+/**
+ * Allocates a free inode and writes it out as an empty file with the given
+ * mode (IALLOC is added), one link and the current time.  Returns the inode
+ * number, or -1 if there are no free inodes or on error.
+ */
+int alloc_inode(struct unixfilesystem *fs, int mode);
+
+/**
+ * Marks inode inumber free.  Its blocks must already have been released.
+ * Returns 0 on success, -1 on error.
+ */
+int alloc_freeinode(struct unixfilesystem *fs, int inumber);
+
+#endif // _ALLOC_H_
@@ -0,0 +1,89 @@
+#include "bitmap.h"
+#include <stdlib.h>
+
+#define BITS_PER_WORD 64
+
+struct bitmap *bitmap_create(int numBits) {
+  if (numBits < 0) return NULL;
+  struct bitmap *bm = malloc(sizeof(struct bitmap));
+  if (bm == NULL) return NULL;
+  int numWords = (numBits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+  bm->words = calloc(numWords > 0 ? numWords : 1, sizeof(uint64_t));
+  if (bm->words == NULL) {
+    free(bm);
+    return NULL;
+  }
+  bm->numBits = numBits;
+  return bm;
+}
+
+void bitmap_free(struct bitmap *bm) {
+  if (bm == NULL) return;
+  free(bm->words);
+  free(bm);
+}
+
+int bitmap_test(const struct bitmap *bm, int bit) {
+  uint64_t word = __atomic_load_n(&bm->words[bit / BITS_PER_WORD], __ATOMIC_RELAXED);
+  return (word >> (bit % BITS_PER_WORD)) & 1;
+}
+
+int bitmap_set(struct bitmap *bm, int bit) {
+  uint64_t mask = (uint64_t) 1 << (bit % BITS_PER_WORD);
+  return (__atomic_fetch_or(&bm->words[bit / BITS_PER_WORD], mask, __ATOMIC_RELAXED) & mask) != 0;
+}
+
+int bitmap_clear(struct bitmap *bm, int bit) {
+  uint64_t mask = (uint64_t) 1 << (bit % BITS_PER_WORD);
+  return (__atomic_fetch_and(&bm->words[bit / BITS_PER_WORD], ~mask, __ATOMIC_RELAXED) & mask) != 0;
+}
+
+int bitmap_count(const struct bitmap *bm) {
+  int count = 0;
+  int numWords = (bm->numBits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+  for (int w = 0; w < numWords; w++) {
+    count += __builtin_popcountll(bm->words[w]);
+  }
+  return count;
+}
+
+int bitmap_countrange(const struct bitmap *bm, int first, int end) {
+  if (first < 0) first = 0;
+  if (end > bm->numBits) end = bm->numBits;
+  if (first >= end) return 0;
+  int firstWord = first / BITS_PER_WORD;
+  int lastWord = (end - 1) / BITS_PER_WORD;
+  uint64_t firstMask = ~(uint64_t) 0 << (first % BITS_PER_WORD);
+  uint64_t lastMask = ~(uint64_t) 0 >> (BITS_PER_WORD - 1 - (end - 1) % BITS_PER_WORD);
+  if (firstWord == lastWord) return __builtin_popcountll(bm->words[firstWord] & firstMask & lastMask);
+
+  int count = __builtin_popcountll(bm->words[firstWord] & firstMask);
+  for (int w = firstWord + 1; w < lastWord; w++) {
+    count += __builtin_popcountll(bm->words[w]);
+  }
+  return count + __builtin_popcountll(bm->words[lastWord] & lastMask);
+}
+
+// Returns the first bit at or after from that differs from the bits of
+// invert, skipping whole words that don't, or numBits if there is none.
+static int find_bit(const struct bitmap *bm, int from, uint64_t invert) {
+  if (from < 0) from = 0;
+  if (from >= bm->numBits) return bm->numBits;
+  int numWords = (bm->numBits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+  int w = from / BITS_PER_WORD;
+  uint64_t word = (bm->words[w] ^ invert) & (~(uint64_t) 0 << (from % BITS_PER_WORD));
+  while (word == 0) {
+    if (++w >= numWords) return bm->numBits;
+    word = bm->words[w] ^ invert;
+  }
+  int bit = w * BITS_PER_WORD + __builtin_ctzll(word);
+  return (bit < bm->numBits) ? bit : bm->numBits;
+}
+
+int bitmap_findset(const struct bitmap *bm, int from) {
+  return find_bit(bm, from, 0);
+}
+
+int bitmap_findclear(const struct bitmap *bm, int from) {
+  return find_bit(bm, from, ~(uint64_t) 0);
+}
@@ -0,0 +1,65 @@
+#ifndef _BITMAP_H_
+#define _BITMAP_H_
+
+#include <stdint.h>
+
+/**
+ * A fixed-size array of bits, one per block or inode, stored 64 to a word.
+ * bitmap_set and bitmap_clear are atomic, so threads can mark bits in a
+ * shared bitmap without a lock.
+ */
+
+struct bitmap {
+  uint64_t *words;
+  int numBits;
+};
+
+/**
+ * Allocates a bitmap of numBits bits, all clear.  Returns NULL when out of
+ * memory.
+ */
+struct bitmap *bitmap_create(int numBits);
+
+/**
+ * Releases the bitmap.
+ */
+void bitmap_free(struct bitmap *bm);
+
+/**
+ * Returns 1 if bit is set, 0 if it is clear.
+ */
+int bitmap_test(const struct bitmap *bm, int bit);
+
+/**
+ * Sets bit and returns its previous value, so exactly one of several threads
+ * setting the same bit sees 0.
+ */
+int bitmap_set(struct bitmap *bm, int bit);
+
+/**
+ * Clears bit and returns its previous value.
+ */
+int bitmap_clear(struct bitmap *bm, int bit);
+
+/**
+ * Returns the number of bits set.
+ */
+int bitmap_count(const struct bitmap *bm);
+
+/**
+ * Returns the number of bits set among bits [first, end).
+ */
+int bitmap_countrange(const struct bitmap *bm, int first, int end);
+
+/**
+ * Returns the first set bit at or after from, or numBits if there is none.
+ * Whole words are skipped at a time.
+ */
+int bitmap_findset(const struct bitmap *bm, int from);
+
+/**
+ * Returns the first clear bit at or after from, or numBits if there is none.
+ */
+int bitmap_findclear(const struct bitmap *bm, int from);
+
+#endif // _BITMAP_H_
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+
+#include "chksumfile.h"
+#include "file.h"
+#include "inode.h"
+#include "pathname.h"
+#include "diskimg.h"
+#include "manifest.h"
+
+// Bytes of file contents hashed per file_read() call.
+#define CHKSUM_READ_SIZE (256 * DISKIMG_SECTOR_SIZE)
+
+int chksumfile_byinumber(struct unixfilesystem *fs, int inumber, void *chksum) {
+  struct inode in;
+  int err = inode_iget(fs, inumber, &in);
+  if (err < 0) return err;
+  if (!(in.i_mode & IALLOC)) {
+    // The inode isn't allocated, so we can't hash it.
+    return -1;
+  }
+  if (fs->manifest != NULL && manifest_lookup(fs->manifest, inumber, &in, chksum)) {
+    return SHA_DIGEST_LENGTH;
+  }
+
+  int size = inode_getsize(&in);
+  EVP_MD_CTX *shactx = EVP_MD_CTX_new();
+  char *buf = malloc(CHKSUM_READ_SIZE);
+  int ok = (shactx != NULL && buf != NULL && EVP_DigestInit_ex(shactx, EVP_sha1(), NULL));
+  for (int offset = 0; ok && offset < size; offset += CHKSUM_READ_SIZE) {
+    int bytesMoved = file_read(fs, inumber, offset, CHKSUM_READ_SIZE, buf);
+    ok = (bytesMoved > 0 && EVP_DigestUpdate(shactx, buf, bytesMoved));
+  }
+  if (ok) ok = EVP_DigestFinal_ex(shactx, chksum, NULL);
+  free(buf);
+  EVP_MD_CTX_free(shactx);
+  if (!ok) return -1;
+
+  if (fs->manifest != NULL) manifest_update(fs->manifest, inumber, &in, chksum);
+  return SHA_DIGEST_LENGTH;
+}
+
+// Domain separation between leaf and interior node hashes of the tree hash,
+// so a leaf can never be mistaken for a pair of children.
+#define TREE_LEAF_PREFIX  0x00
+#define TREE_NODE_PREFIX  0x01
+
+// Computes the SHA-1 of a one byte prefix followed by len bytes of data.
+static int hash_prefixed(unsigned char prefix, const void *data, size_t len, void *chksum) {
+  EVP_MD_CTX *shactx = EVP_MD_CTX_new();
+  int ok = (shactx != NULL && EVP_DigestInit_ex(shactx, EVP_sha1(), NULL) &&
+            EVP_DigestUpdate(shactx, &prefix, 1) && EVP_DigestUpdate(shactx, data, len) &&
+            EVP_DigestFinal_ex(shactx, chksum, NULL));
+  EVP_MD_CTX_free(shactx);
+  return ok ? 0 : -1;
+}
+
+/**
+ * State shared by the threads of one tree hash.  Workers claim leaves in
+ * order and store each leaf's hash at its index in leaves.
+ */
+struct treehash {
+  struct unixfilesystem *fs;
+  int inumber;
+  int size;
+  int numLeaves;
+  unsigned char *leaves;   // numLeaves hashes of SHA_DIGEST_LENGTH bytes
+  int nextLeaf;
+  int err;
+  pthread_mutex_t lock;
+};
+
+// Hashes leaf leafNo of a file of the given size, using buf (at least
+// CHKSUMFILE_LEAF_SIZE bytes) for its contents.
+static int hash_leaf(struct unixfilesystem *fs, int inumber, int size, int leafNo, char *buf, void *chksum) {
+  int offset = leafNo * CHKSUMFILE_LEAF_SIZE;
+  int len = (size - offset < CHKSUMFILE_LEAF_SIZE) ? size - offset : CHKSUMFILE_LEAF_SIZE;
+  if (len < 0) return -1;
+  if (len > 0 && file_read(fs, inumber, offset, len, buf) != len) return -1;
+
+  return hash_prefixed(TREE_LEAF_PREFIX, buf, len, chksum);
+}
+
+static void *tree_worker(void *arg) {
+  struct treehash *tree = arg;
+  char *buf = malloc(CHKSUMFILE_LEAF_SIZE);
+  while (1) {
+    pthread_mutex_lock(&tree->lock);
+    if (buf == NULL) tree->err = -1;
+    int leafNo = tree->err ? tree->numLeaves : tree->nextLeaf++;
+    pthread_mutex_unlock(&tree->lock);
+    if (leafNo >= tree->numLeaves) break;
+
+    if (hash_leaf(tree->fs, tree->inumber, tree->size, leafNo, buf,
+                  tree->leaves + (size_t) leafNo * SHA_DIGEST_LENGTH) < 0) {
+      pthread_mutex_lock(&tree->lock);
+      tree->err = -1;
+      pthread_mutex_unlock(&tree->lock);
+    }
+  }
+  free(buf);
+  return NULL;
+}
+
+// Reduces numNodes hashes, level by level, to the root hash.  Each level
+// hashes pairs of neighbours; an odd node out moves up unchanged.
+static int combine_tree(unsigned char *nodes, int numNodes, void *chksum) {
+  while (numNodes > 1) {
+    for (int i = 0; i < numNodes / 2; i++) {
+      if (hash_prefixed(TREE_NODE_PREFIX, nodes + 2 * i * SHA_DIGEST_LENGTH, 2 * SHA_DIGEST_LENGTH,
+                        nodes + i * SHA_DIGEST_LENGTH) < 0) {
+        return -1;
+      }
+    }
+    if (numNodes % 2) {
+      memmove(nodes + (numNodes / 2) * SHA_DIGEST_LENGTH, nodes + (numNodes - 1) * SHA_DIGEST_LENGTH,
+              SHA_DIGEST_LENGTH);
+    }
+    numNodes = (numNodes + 1) / 2;
+  }
+  memcpy(chksum, nodes, SHA_DIGEST_LENGTH);
+  return 0;
+}
+
+int chksumfile_treebyinumber(struct unixfilesystem *fs, int inumber, void *chksum, int numThreads) {
+  struct inode in;
+  int err = inode_iget(fs, inumber, &in);
+  if (err < 0) return err;
+  if (!(in.i_mode & IALLOC)) return -1;
+
+  struct treehash tree;
+  tree.fs = fs;
+  tree.inumber = inumber;
+  tree.size = inode_getsize(&in);
+  tree.numLeaves = (tree.size == 0) ? 1 : (tree.size + CHKSUMFILE_LEAF_SIZE - 1) / CHKSUMFILE_LEAF_SIZE;
+  tree.leaves = malloc((size_t) tree.numLeaves * SHA_DIGEST_LENGTH);
+  if (tree.leaves == NULL) return -1;
+  tree.nextLeaf = 0;
+  tree.err = 0;
+  pthread_mutex_init(&tree.lock, NULL);
+
+  // This thread hashes leaves too, so only start helpers for the rest.
+  int numHelpers = (numThreads < tree.numLeaves ? numThreads : tree.numLeaves) - 1;
+  pthread_t helpers[numHelpers > 0 ? numHelpers : 1];
+  int numStarted = 0;
+  while (numStarted < numHelpers && pthread_create(&helpers[numStarted], NULL, tree_worker, &tree) == 0) {
+    numStarted++;
+  }
+  tree_worker(&tree);
+  for (int t = 0; t < numStarted; t++) {
+    pthread_join(helpers[t], NULL);
+  }
+  pthread_mutex_destroy(&tree.lock);
+
+  if (tree.err == 0) tree.err = combine_tree(tree.leaves, tree.numLeaves, chksum);
+  free(tree.leaves);
+  return (tree.err < 0) ? -1 : SHA_DIGEST_LENGTH;
+}
+
+int chksumfile_treeleaf(struct unixfilesystem *fs, int inumber, int leafNo, void *chksum) {
+  struct inode in;
+  int err = inode_iget(fs, inumber, &in);
+  if (err < 0) return err;
+  if (!(in.i_mode & IALLOC)) return -1;
+
+  int size = inode_getsize(&in);
+  if (leafNo < 0 || (leafNo > 0 && leafNo * CHKSUMFILE_LEAF_SIZE >= size)) return -1;
+  char *buf = malloc(CHKSUMFILE_LEAF_SIZE);
+  if (buf == NULL) return -1;
+  err = hash_leaf(fs, inumber, size, leafNo, buf, chksum);
+  free(buf);
+  return (err < 0) ? -1 : SHA_DIGEST_LENGTH;
+}
+
+int chksumfile_bypathname(struct unixfilesystem *fs, const char *pathname, void *chksum) {
+  int inumber = pathname_lookup(fs, pathname);
+  if (inumber < 0) return inumber;
+  return chksumfile_byinumber(fs, inumber, chksum);
+}
+
+void chksumfile_cvt2string(void *chksum, char *outstring) {
+  unsigned char *c = chksum;
+  for (int i = 0; i < CHKSUMFILE_SIZE; i++) {
+    sprintf(outstring + 2 * i, "%02x", c[i]);
+  }
+}
+
+int chksumfile_compare(void *chksum1, void *chksum2) {
+  unsigned char *c1 = chksum1;
+  unsigned char *c2 = chksum2;
+  for (int i = 0; i < CHKSUMFILE_SIZE; i++) {
+    if (c1[i] != c2[i]) return 0;
+  }
+  return 1;
+}
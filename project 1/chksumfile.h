@@ -6,13 +6,37 @@
 #define CHKSUMFILE_SIZE 20   
 #define CHKSUMFILE_STRINGSIZE ((2*CHKSUMFILE_SIZE)+1)
 
+// Bytes of file contents covered by each leaf of the tree hash.
+#define CHKSUMFILE_LEAF_SIZE (256 * 512)
+
 /**
  * Computes the checksum of a inumber.  Assumes chksum arguments points to a
- * CHKSUMFILE_SIZE byte array.  Returns the length of the checksum, or -1 if
- * it encounters an error.
+ * CHKSUMFILE_SIZE byte array.  If the filesystem has a manifest, a checksum
+ * recorded there for the unchanged inode is returned without reading the
+ * file, and newly computed checksums are recorded.  Returns the length of the
+ * checksum, or -1 if it encounters an error.
  */
 int chksumfile_byinumber(struct unixfilesystem *fs, int inumber, void *chksum);
 
+/**
+ * Computes the tree hash of a inumber, a checksum that can be spread over
+ * several threads and, unlike chksumfile_byinumber, partly recomputed.  The
+ * file is split into CHKSUMFILE_LEAF_SIZE byte leaves, each hashed
+ * separately as SHA-1(0x00 || contents); pairs of neighbouring hashes are
+ * then hashed as SHA-1(0x01 || left || right), an odd one out moving up a
+ * level unchanged, until one root hash is left.  An empty file is one empty
+ * leaf.  Leaves are hashed by up to numThreads threads.  The manifest is not
+ * used.  Returns the length of the checksum, or -1 if it encounters an error.
+ */
+int chksumfile_treebyinumber(struct unixfilesystem *fs, int inumber, void *chksum, int numThreads);
+
+/**
+ * Computes the hash of leaf leafNo of the tree hash of a inumber, so a change
+ * to part of a file can be checked without rehashing the rest.  Returns the
+ * length of the checksum, or -1 if it encounters an error.
+ */
+int chksumfile_treeleaf(struct unixfilesystem *fs, int inumber, int leafNo, void *chksum);
+
 /**
  * Compute the checksum of the specified pathname.  Assumes chksum points to a
  * CHKSUMFILE_SIZE byte array. Returns the length of the checksum or -1 if
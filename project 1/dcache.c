@@ -0,0 +1,113 @@
+#include "dcache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+struct dentry {
+  struct dentry *next;  // next entry in the same bucket
+  int inumber;
+  size_t len;
+  char path[];          // not null terminated
+};
+
+struct dcache {
+  int maxEntries;
+  int numEntries;
+  unsigned int bucketMask;  // number of buckets minus one
+  struct dentry **buckets;
+  pthread_mutex_t lock;     // held by every public operation
+};
+
+// FNV-1a over the path prefix.
+static unsigned int hash_path(const char *path, size_t len) {
+  unsigned int h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (unsigned char) path[i]) * 16777619u;
+  }
+  return h;
+}
+
+static struct dentry **find_entry(struct dcache *cache, const char *path, size_t len) {
+  struct dentry **link = &cache->buckets[hash_path(path, len) & cache->bucketMask];
+  while (*link != NULL && ((*link)->len != len || memcmp((*link)->path, path, len) != 0)) {
+    link = &(*link)->next;
+  }
+  return link;
+}
+
+static void clear_entries(struct dcache *cache) {
+  for (unsigned int b = 0; b <= cache->bucketMask; b++) {
+    while (cache->buckets[b] != NULL) {
+      struct dentry *entry = cache->buckets[b];
+      cache->buckets[b] = entry->next;
+      free(entry);
+    }
+  }
+  cache->numEntries = 0;
+}
+
+struct dcache *dcache_create(int maxEntries) {
+  if (maxEntries < 1) return NULL;
+  struct dcache *cache = malloc(sizeof(struct dcache));
+  if (cache == NULL) return NULL;
+
+  int numBuckets = 1;
+  while (numBuckets < maxEntries) numBuckets <<= 1;
+  cache->maxEntries = maxEntries;
+  cache->numEntries = 0;
+  cache->bucketMask = numBuckets - 1;
+  cache->buckets = calloc(numBuckets, sizeof(struct dentry *));
+  if (cache->buckets == NULL) {
+    free(cache);
+    return NULL;
+  }
+  pthread_mutex_init(&cache->lock, NULL);
+  return cache;
+}
+
+void dcache_free(struct dcache *cache) {
+  if (cache == NULL) return;
+  clear_entries(cache);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->buckets);
+  free(cache);
+}
+
+int dcache_lookup(struct dcache *cache, const char *path, size_t len) {
+  pthread_mutex_lock(&cache->lock);
+  struct dentry *entry = *find_entry(cache, path, len);
+  int inumber = (entry == NULL) ? -1 : entry->inumber;
+  pthread_mutex_unlock(&cache->lock);
+  return inumber;
+}
+
+void dcache_insert(struct dcache *cache, const char *path, size_t len, int inumber) {
+  pthread_mutex_lock(&cache->lock);
+  struct dentry **link = find_entry(cache, path, len);
+  if (*link != NULL) {
+    (*link)->inumber = inumber;
+    pthread_mutex_unlock(&cache->lock);
+    return;
+  }
+
+  if (cache->numEntries >= cache->maxEntries) {
+    clear_entries(cache);
+    link = find_entry(cache, path, len);
+  }
+  struct dentry *entry = malloc(sizeof(struct dentry) + len);
+  if (entry != NULL) {
+    entry->next = NULL;
+    entry->inumber = inumber;
+    entry->len = len;
+    memcpy(entry->path, path, len);
+    *link = entry;
+    cache->numEntries++;
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void dcache_clear(struct dcache *cache) {
+  pthread_mutex_lock(&cache->lock);
+  clear_entries(cache);
+  pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,47 @@
+#ifndef _DCACHE_H_
+#define _DCACHE_H_
+
+#include <stddef.h>
+
+/**
+ * A cache mapping absolute path prefixes (e.g. "/a/b") to inode numbers, used
+ * by pathname_lookup to avoid walking down from the root for every lookup.
+ * Names known not to exist are cached too, as negative entries.  Keys are
+ * canonical: one '/' before each component and none at the end.  All
+ * operations are thread safe.
+ */
+
+#define DCACHE_NEGATIVE 0   // "inumber" of a path known not to exist
+
+struct dcache;
+
+/**
+ * Allocates an empty cache that holds up to maxEntries paths.  Returns NULL
+ * when out of memory.
+ */
+struct dcache *dcache_create(int maxEntries);
+
+/**
+ * Releases the cache.
+ */
+void dcache_free(struct dcache *cache);
+
+/**
+ * Looks up the first len characters of path.  Returns the cached inumber,
+ * DCACHE_NEGATIVE if the path is known not to exist, or -1 if the path is not
+ * cached.
+ */
+int dcache_lookup(struct dcache *cache, const char *path, size_t len);
+
+/**
+ * Records that the first len characters of path name inumber, or don't exist
+ * if inumber is DCACHE_NEGATIVE.  When the cache is full it starts over empty.
+ */
+void dcache_insert(struct dcache *cache, const char *path, size_t len, int inumber);
+
+/**
+ * Forgets every cached path.
+ */
+void dcache_clear(struct dcache *cache);
+
+#endif // _DCACHE_H_
@@ -2,10 +2,53 @@
 #include "inode.h"
 #include "diskimg.h"
 #include "file.h"
+#include "dirindex.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
+// Directories at least this many blocks long are looked up through a hash
+// index; smaller ones are cheaper to scan.
+#define DIRINDEX_MIN_BLOCKS 2
+
+/**
+ * Reads every entry of the directory into a new array and hands it to the
+ * filesystem's directory index.  Returns 0 on success, -1 on error.
+ */
+static int index_directory(struct unixfilesystem *fs, int dirinumber, int size) {
+  struct direntv6 *entries = malloc(size + 1);
+  if (entries == NULL) return -1;
+
+  struct directory_iter it;
+  if (directory_open(fs, dirinumber, &it) < 0) {
+    free(entries);
+    return -1;
+  }
+  int count = 0;
+  const struct direntv6 *dir;
+  int err;
+  while ((err = directory_next(&it, &dir)) > 0) {
+    entries[count++] = *dir;
+  }
+  directory_close(&it);
+  if (err < 0) {
+    free(entries);
+    return -1;
+  }
+  return dirindex_add(fs->dirindex, dirinumber, entries, count);
+}
+
+static int findname_indexed(struct unixfilesystem *fs, const char *name, int dirinumber,
+                            int size, struct direntv6 *dirEnt) {
+  int found = dirindex_lookup(fs->dirindex, dirinumber, name, dirEnt);
+  if (found < 0) {
+    if (index_directory(fs, dirinumber, size) < 0) return -1;
+    found = dirindex_lookup(fs->dirindex, dirinumber, name, dirEnt);
+  }
+  return (found == 1) ? 0 : -1;
+}
+
 /**
  * Looks up the specified name (name) in the specified directory (dirinumber).  
  * If found, return the directory entry in space addressed by dirEnt.  Returns 0 
@@ -27,17 +70,89 @@ int directory_findname(struct unixfilesystem *fs, const char *name, int dirinumb
 
 	int size = inode_getsize(&i);
 	int numBlocks  = (size + DISKIMG_SECTOR_SIZE - 1) / DISKIMG_SECTOR_SIZE;
-	char buf[DISKIMG_SECTOR_SIZE];
-	struct direntv6 *dir = (struct direntv6 *) buf;
-	for (int i=0; i<numBlocks; i++) {
-  	int bytesLeft = file_getblock(fs, dirinumber, i, dir);
-  	int num = bytesLeft/sizeof(struct direntv6);
-  	for (int i=0; i<num ; i++) {
-    		if (strcmp(name, dir[i].d_name) == 0) {
-      		*dirEnt = dir[i];
-      		return 0;
-    		}
+	if (fs->dirindex != NULL && numBlocks >= DIRINDEX_MIN_BLOCKS) {
+		return findname_indexed(fs, name, dirinumber, size, dirEnt);
+	}
+	struct directory_iter it;
+	if (directory_open(fs, dirinumber, &it) < 0) {
+  	return -1;
+	}
+	const struct direntv6 *dir;
+	int found = -1;
+	while (directory_next(&it, &dir) > 0) {
+  	if (strncmp(name, dir->d_name, sizeof(dir->d_name)) == 0) {
+    	*dirEnt = *dir;
+    	found = 0;
+    	break;
   	}
 	}
-	return -1;
+	directory_close(&it);
+	return found;
+}
+
+int directory_open(struct unixfilesystem *fs, int dirinumber, struct directory_iter *it) {
+  struct inode in;
+  if (inode_iget(fs, dirinumber, &in) < 0) return -1;
+  if (!(in.i_mode & IALLOC) || ((in.i_mode & IFMT) != IFDIR)) return -1;
+
+  int size = inode_getsize(&in);
+  it->fs = fs;
+  it->dirinumber = dirinumber;
+  it->numBlocks = (size + DISKIMG_SECTOR_SIZE - 1) / DISKIMG_SECTOR_SIZE;
+  it->blockNo = 0;
+  it->entries = NULL;
+  it->numEntries = 0;
+  it->next = 0;
+  return 0;
+}
+
+int directory_next(struct directory_iter *it, const struct direntv6 **dirEnt) {
+  while (it->next >= it->numEntries) {
+    if (it->blockNo >= it->numBlocks) return 0;
+    const void *block;
+    int bytesLeft = file_getblockref(it->fs, it->dirinumber, it->blockNo, it->buf, &block);
+    if (bytesLeft < 0) return -1;
+    it->blockNo++;
+    it->entries = block;
+    it->numEntries = bytesLeft / sizeof(struct direntv6);
+    it->next = 0;
+  }
+  *dirEnt = &it->entries[it->next++];
+  return 1;
+}
+
+void directory_close(struct directory_iter *it) {
+  // The iterator owns no heap resources (entries point into the mapping or
+  // it->buf), so just make further directory_next calls end the walk.
+  it->numBlocks = 0;
+  it->numEntries = 0;
+}
+
+int directory_addentry(struct unixfilesystem *fs, int dirinumber, const char *name, int inumber) {
+  struct direntv6 entry;
+  if (name[0] == '\0' || strchr(name, '/') != NULL || strlen(name) > sizeof(entry.d_name)) {
+    fprintf(stderr, "Bad directory entry name %s\n", name);
+    return -1;
+  }
+  if (directory_findname(fs, name, dirinumber, &entry) == 0) {
+    fprintf(stderr, "%s already exists\n", name);
+    return -1;
+  }
+
+  // Reuse the first empty slot, or else append.
+  struct directory_iter it;
+  if (directory_open(fs, dirinumber, &it) < 0) return -1;
+  int offset = 0;
+  const struct direntv6 *dir;
+  int err;
+  while ((err = directory_next(&it, &dir)) > 0 && dir->d_inumber != 0) {
+    offset += sizeof(struct direntv6);
+  }
+  directory_close(&it);
+  if (err < 0) return -1;
+
+  entry.d_inumber = inumber;
+  strncpy(entry.d_name, name, sizeof(entry.d_name));
+  if (file_write(fs, dirinumber, offset, sizeof(entry), &entry) != sizeof(entry)) return -1;
+  return 0;
 }
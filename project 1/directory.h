@@ -0,0 +1,58 @@
+#ifndef _DIRECTORY_H_
+#define _DIRECTORY_H_
+
+#include "unixfilesystem.h"
+#include "diskimg.h"
+
+/**
+ * Looks up the specified name (name) in the specified directory (dirinumber).
+ * If found, return the directory entry in space addressed by dirEnt.  Returns 0
+ * on success and something negative on failure.
+ */
+int directory_findname(struct unixfilesystem *fs, const char *name, int dirinumber, struct direntv6 *dirEnt);
+
+/**
+ * Adds an entry named name for inumber to directory dirinumber, reusing an
+ * empty slot if there is one.  The caller is responsible for the link count
+ * of inumber.  Not thread safe.
+ * Returns 0 on success, or -1 if name is invalid or already present, or on
+ * error.
+ */
+int directory_addentry(struct unixfilesystem *fs, int dirinumber, const char *name, int inumber);
+
+/**
+ * State of a walk over the entries of one directory.  The caller provides the
+ * storage (typically on the stack); only one block of entries is held at a
+ * time, so directories of any size are walked in constant space.
+ */
+struct directory_iter {
+  struct unixfilesystem *fs;
+  int dirinumber;
+  int numBlocks;
+  int blockNo;                      // next block to fetch
+  const struct direntv6 *entries;   // entries of the current block
+  int numEntries;
+  int next;                         // index of the next entry to return
+  char buf[DISKIMG_SECTOR_SIZE];
+};
+
+/**
+ * Starts a walk over the entries of directory dirinumber.  Returns 0 on
+ * success, or -1 if the inode can't be read or is not an allocated directory.
+ */
+int directory_open(struct unixfilesystem *fs, int dirinumber, struct directory_iter *it);
+
+/**
+ * Sets *dirEnt to the next entry of the directory, in directory order.  The
+ * entry points into the iterator or the mapped disk image and is only valid
+ * until the next call; it must not be modified.  Returns 1 if an entry was
+ * returned, 0 at the end of the directory and -1 on error.
+ */
+int directory_next(struct directory_iter *it, const struct direntv6 **dirEnt);
+
+/**
+ * Ends the walk.
+ */
+void directory_close(struct directory_iter *it);
+
+#endif // _DIRECTORY_H_
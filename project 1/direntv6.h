@@ -0,0 +1,17 @@
+#ifndef _DIRENTV6_H_
+#define _DIRENTV6_H_
+
+#include <stdint.h>
+
+/**
+ * The Unix Version 6 code didn't use a structure like this but this is
+ * the format of a directory entry.  A directory is a file made of an array
+ * of these 16-byte entries.  Names are at most 14 characters and are not
+ * null terminated when they use all 14.
+ */
+struct direntv6 {
+  uint16_t d_inumber;
+  char     d_name[14];
+};
+
+#endif // _DIRENTV6_H_
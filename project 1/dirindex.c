@@ -0,0 +1,143 @@
+#include "dirindex.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define DIRINDEX_DIR_BUCKETS 256  // buckets for finding a directory by inumber
+#define NO_ENTRY (-1)
+#define NAME_LEN sizeof(((struct direntv6 *) 0)->d_name)
+
+struct indexeddir {
+  int dirinumber;
+  int numEntries;
+  struct direntv6 *entries;
+  unsigned int bucketMask;    // number of name buckets minus one
+  int *buckets;               // first entry in each name bucket
+  int *chain;                 // next entry in the same name bucket
+  struct indexeddir *next;    // next directory in the same inumber bucket
+};
+
+struct dirindex {
+  struct indexeddir *dirs[DIRINDEX_DIR_BUCKETS];
+  pthread_mutex_t lock;     // held by every public operation
+};
+
+// FNV-1a over the significant (at most 14) characters of a name.
+static unsigned int hash_name(const char *name) {
+  unsigned int h = 2166136261u;
+  for (size_t i = 0; i < NAME_LEN && name[i] != '\0'; i++) {
+    h = (h ^ (unsigned char) name[i]) * 16777619u;
+  }
+  return h;
+}
+
+static int name_matches(const char *name, const struct direntv6 *entry) {
+  return strncmp(name, entry->d_name, NAME_LEN) == 0;
+}
+
+static struct indexeddir **find_dir(struct dirindex *index, int dirinumber) {
+  struct indexeddir **link = &index->dirs[(unsigned int) dirinumber % DIRINDEX_DIR_BUCKETS];
+  while (*link != NULL && (*link)->dirinumber != dirinumber) {
+    link = &(*link)->next;
+  }
+  return link;
+}
+
+static void free_dir(struct indexeddir *dir) {
+  free(dir->entries);
+  free(dir->buckets);
+  free(dir->chain);
+  free(dir);
+}
+
+static void remove_dir(struct dirindex *index, int dirinumber) {
+  struct indexeddir **link = find_dir(index, dirinumber);
+  if (*link != NULL) {
+    struct indexeddir *dir = *link;
+    *link = dir->next;
+    free_dir(dir);
+  }
+}
+
+struct dirindex *dirindex_create(void) {
+  struct dirindex *index = calloc(1, sizeof(struct dirindex));
+  if (index != NULL) pthread_mutex_init(&index->lock, NULL);
+  return index;
+}
+
+void dirindex_free(struct dirindex *index) {
+  if (index == NULL) return;
+  for (int b = 0; b < DIRINDEX_DIR_BUCKETS; b++) {
+    while (index->dirs[b] != NULL) {
+      struct indexeddir *dir = index->dirs[b];
+      index->dirs[b] = dir->next;
+      free_dir(dir);
+    }
+  }
+  pthread_mutex_destroy(&index->lock);
+  free(index);
+}
+
+int dirindex_lookup(struct dirindex *index, int dirinumber, const char *name, struct direntv6 *dirEnt) {
+  pthread_mutex_lock(&index->lock);
+  struct indexeddir *dir = *find_dir(index, dirinumber);
+  int found = (dir == NULL) ? -1 : 0;
+  if (dir != NULL) {
+    int e = dir->buckets[hash_name(name) & dir->bucketMask];
+    while (e != NO_ENTRY && !name_matches(name, &dir->entries[e])) {
+      e = dir->chain[e];
+    }
+    if (e != NO_ENTRY) {
+      *dirEnt = dir->entries[e];
+      found = 1;
+    }
+  }
+  pthread_mutex_unlock(&index->lock);
+  return found;
+}
+
+int dirindex_add(struct dirindex *index, int dirinumber, struct direntv6 *entries, int numEntries) {
+  struct indexeddir *dir = malloc(sizeof(struct indexeddir));
+  if (dir == NULL) {
+    free(entries);
+    return -1;
+  }
+
+  int numBuckets = 1;
+  while (numBuckets < numEntries) numBuckets <<= 1;
+  dir->dirinumber = dirinumber;
+  dir->numEntries = numEntries;
+  dir->entries = entries;
+  dir->bucketMask = numBuckets - 1;
+  dir->buckets = malloc(numBuckets * sizeof(int));
+  dir->chain = malloc((numEntries > 0 ? numEntries : 1) * sizeof(int));
+  if (dir->buckets == NULL || dir->chain == NULL) {
+    free_dir(dir);
+    return -1;
+  }
+
+  for (int b = 0; b < numBuckets; b++) {
+    dir->buckets[b] = NO_ENTRY;
+  }
+  // Insert back to front so that, like a linear scan, the first of several
+  // entries with the same name is found.
+  for (int e = numEntries - 1; e >= 0; e--) {
+    unsigned int b = hash_name(entries[e].d_name) & dir->bucketMask;
+    dir->chain[e] = dir->buckets[b];
+    dir->buckets[b] = e;
+  }
+
+  pthread_mutex_lock(&index->lock);
+  remove_dir(index, dirinumber);
+  struct indexeddir **bucket = &index->dirs[(unsigned int) dirinumber % DIRINDEX_DIR_BUCKETS];
+  dir->next = *bucket;
+  *bucket = dir;
+  pthread_mutex_unlock(&index->lock);
+  return 0;
+}
+
+void dirindex_invalidate(struct dirindex *index, int dirinumber) {
+  pthread_mutex_lock(&index->lock);
+  remove_dir(index, dirinumber);
+  pthread_mutex_unlock(&index->lock);
+}
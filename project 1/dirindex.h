@@ -0,0 +1,46 @@
+#ifndef _DIRINDEX_H_
+#define _DIRINDEX_H_
+
+#include "direntv6.h"
+
+/**
+ * A cache of per-directory hash tables used by directory_findname.  Each
+ * indexed directory keeps a copy of its entries hashed by their 14-byte name,
+ * so repeated lookups in a large directory don't rescan all of its blocks.
+ * Names compare like the V6 kernel does: only the first 14 characters count.
+ * All operations are thread safe.
+ */
+
+struct dirindex;
+
+/**
+ * Allocates an empty index cache.  Returns NULL when out of memory.
+ */
+struct dirindex *dirindex_create(void);
+
+/**
+ * Releases the cache and every directory index in it.
+ */
+void dirindex_free(struct dirindex *index);
+
+/**
+ * Looks up name in the index of directory dirinumber.  Returns 1 and fills in
+ * dirEnt if the name is present, 0 if it is absent, and -1 if the directory
+ * has not been indexed.
+ */
+int dirindex_lookup(struct dirindex *index, int dirinumber, const char *name, struct direntv6 *dirEnt);
+
+/**
+ * Indexes directory dirinumber, whose contents are the numEntries entries in
+ * entries.  The cache takes ownership of the entries array, which must have
+ * been allocated with malloc.  Returns 0 on success, or -1 on error, in which
+ * case entries has been freed.
+ */
+int dirindex_add(struct dirindex *index, int dirinumber, struct direntv6 *entries, int numEntries);
+
+/**
+ * Drops the index of directory dirinumber, if any.
+ */
+void dirindex_invalidate(struct dirindex *index, int dirinumber);
+
+#endif // _DIRINDEX_H_
@@ -12,20 +12,30 @@
 #include "directory.h"
 #include "pathname.h"
 #include "chksumfile.h"
+#include "manifest.h"
+#include "iostats.h"
+#include "freemap.h"
+#include "dump.h"
 
 int quietFlag = 0; 
 int idumpFlag = 0;
 int pdumpFlag = 0;
+int cacheSlots = 0;
+int cachePolicy = SECTORCACHE_CLOCK;
+int fsFlags = 0;
+int numThreads = 1;
+char *manifestPath = NULL;
+int treeThreads = 0;    // tree hash with this many threads per file, 0 for the linear checksum
+char *tracePath = NULL; // binary trace of every sector access, and print the I/O counters
+int freeSpaceFlag = 0;
 
 static void PrintDirectory(struct unixfilesystem *fs,  char *pathname);
-static void DumpInodeChecksum(struct unixfilesystem *fs, FILE *f);
-static void DumpPathnameChecksum(struct unixfilesystem *fs, FILE *f);
+static void PrintFreeSpace(struct unixfilesystem *fs);
 static void PrintUsageAndExit(char *progname);
-static int GetDirEntries(struct unixfilesystem *fs, int inumber, struct direntv6 *entries, int maxNumEntries);
 
 int main(int argc, char *argv[]) {
   int opt;
-  while ((opt = getopt(argc, argv, "iqp")) != -1) {
+  while ((opt = getopt(argc, argv, "iqpc:lmtrj:s:T:I:F")) != -1) {
     switch (opt) {
     case 'q':
       quietFlag = 1;
@@ -36,12 +46,44 @@ int main(int argc, char *argv[]) {
     case 'p':
       pdumpFlag = 1;
       break;
+    case 'c':
+      cacheSlots = atoi(optarg);
+      break;
+    case 'l':
+      cachePolicy = SECTORCACHE_LRU;
+      break;
+    case 'm':
+      fsFlags |= UNIXFILESYSTEM_MMAP;
+      break;
+    case 't':
+      fsFlags |= UNIXFILESYSTEM_ITABLE;
+      break;
+    case 'r':
+      fsFlags |= UNIXFILESYSTEM_READAHEAD;
+      break;
+    case 'j':
+      numThreads = atoi(optarg);
+      if (numThreads < 1) PrintUsageAndExit(argv[0]);
+      break;
+    case 's':
+      manifestPath = optarg;
+      break;
+    case 'T':
+      treeThreads = atoi(optarg);
+      if (treeThreads < 1) PrintUsageAndExit(argv[0]);
+      break;
+    case 'I':
+      tracePath = optarg;
+      break;
+    case 'F':
+      freeSpaceFlag = 1;
+      break;
     default: 
       PrintUsageAndExit(argv[0]);
     } 
   }
 
-  if (optind != argc-1) {
+  if (optind != argc-1 || (manifestPath != NULL && treeThreads > 0)) {
     PrintUsageAndExit(argv[0]);
   }
 
@@ -53,20 +95,30 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
-  struct unixfilesystem *fs = unixfilesystem_init(fd);
+  if (cacheSlots > 0 && diskimg_setcache(fd, cacheSlots, cachePolicy) < 0) {
+    fprintf(stderr, "Can't set up a %d sector cache\n", cacheSlots);
+    exit(EXIT_FAILURE);
+  }
+
+  struct unixfilesystem *fs = unixfilesystem_initflags(fd, fsFlags);
   if (!fs) {
     fprintf(stderr, "Failed to initialize unix filesystem\n");
     exit(EXIT_FAILURE);
   }
 
+  if (tracePath != NULL && (fs->iostats == NULL || iostats_starttrace(fs->iostats, tracePath) < 0)) {
+    fprintf(stderr, "Can't start I/O trace %s\n", tracePath);
+    exit(EXIT_FAILURE);
+  }
+
   if (!quietFlag) {  
     int disksize = diskimg_getsize(fd);
     if (disksize < 0) {
       fprintf(stderr, "Error getting the size of %s\n", argv[1]);
+      unixfilesystem_free(fs);
       // Cast the result of diskimg_close to void so the compiler doesn't
       // complain that we're ignoring its return value.
       (void) diskimg_close(fd);
-      free(fs);
       exit(EXIT_FAILURE);
     }
     printf("Disk %s is %d bytes (%d KB)\n", argv[1],  disksize, disksize/1024);
@@ -76,121 +128,45 @@ int main(int argc, char *argv[]) {
     printf("Superblock s_ninode %d\n",(int)fs->superblock.s_ninode);
   }
 
-  if (idumpFlag) DumpInodeChecksum(fs, stdout);
-  if (pdumpFlag) DumpPathnameChecksum(fs, stdout);
+  if (freeSpaceFlag) PrintFreeSpace(fs);
 
-  int err = diskimg_close(fd);
-  if (err < 0) fprintf(stderr, "Error closing %s\n", argv[1]);
-  free(fs);
-  exit(EXIT_SUCCESS);
-  return 0;
-}
-
-/**
- * Output to the specified file the checksum of all allocated inodes.
- *
- * This is used by the grading script, so be careful not to change its output
- * format.
- */
-static void DumpInodeChecksum(struct unixfilesystem *fs, FILE *f) {
-  for (int inumber = 1; inumber < fs->superblock.s_isize*16; inumber++) {
-    struct inode in;
-    if (inode_iget(fs, inumber, &in) < 0) {
-      fprintf(stderr,"Can't read inode %d \n", inumber);
-      return;
-    }
-    if ((in.i_mode & IALLOC) == 0) {
-      // Skip this inode if it's not allocated.
-      continue;
-    }
-
-    char chksum[CHKSUMFILE_SIZE];
-    if (chksumfile_byinumber(fs, inumber, chksum) < 0) {
-      fprintf(stderr, "Inode %d can't compute chksum\n", inumber);
-      continue;
+  if (manifestPath != NULL) {
+    fs->manifest = manifest_open(manifestPath, fs->superblock.s_isize*16);
+    if (fs->manifest == NULL) {
+      fprintf(stderr, "Can't load manifest %s\n", manifestPath);
+      exit(EXIT_FAILURE);
     }
-
-    char chksumstring[CHKSUMFILE_STRINGSIZE];
-    chksumfile_cvt2string(chksum, chksumstring);
-
-    int size = inode_getsize(&in);
-    fprintf(f, "Inode %d mode 0x%x size %d checksum %s\n",inumber,in.i_mode, size, chksumstring);
   }
-}
 
-/**
- * Output to the specified file the checksum of the specified pathname and
- * inode as well as all its children if it is a directory.
- *
- * This is used by the grading script, so be careful not to change its output
- * format.
- */
-static void DumpPathAndChildren(struct unixfilesystem *fs, const char *pathname, int inumber, FILE *f) {
-  struct inode in;
-  if (inode_iget(fs, inumber, &in) < 0) {
-    fprintf(stderr,"Can't read inode %d \n", inumber);
-    return;
-  }
-  assert(in.i_mode & IALLOC);
-
-  char chksum1[CHKSUMFILE_SIZE];
-  if (chksumfile_byinumber(fs, inumber, chksum1) < 0) {
-    fprintf(stderr,"Can't checksum inode %d path %s\n", inumber, pathname);
-    return;
-  }
-
-  char chksum2[CHKSUMFILE_SIZE];
-  if (chksumfile_bypathname(fs, pathname, chksum2) < 0) {
-    fprintf(stderr,"Can't checksum inode %d path %s\n", inumber, pathname);
-    return;
-  }
+  struct dump_options dumpOptions = { numThreads, treeThreads };
+  if (idumpFlag) dump_inodes(fs, &dumpOptions, stdout);
+  if (pdumpFlag) dump_paths(fs, &dumpOptions, stdout);
 
-  if (!chksumfile_compare(chksum1, chksum2)) {
-    fprintf(stderr,"Pathname checksum of %s differs from inode %d\n", pathname, inumber);
-    return;
+  if (fs->manifest != NULL) {
+    struct manifest_stats mstats;
+    manifest_getstats(fs->manifest, &mstats);
+    if (!quietFlag) {
+      fprintf(stderr, "Manifest %llu checksums reused %llu computed\n", mstats.hits, mstats.misses);
+    }
+    if (manifest_save(fs->manifest) < 0) fprintf(stderr, "Error saving manifest %s\n", manifestPath);
+    manifest_free(fs->manifest);
+    fs->manifest = NULL;
   }
 
-  char chksumstring[CHKSUMFILE_STRINGSIZE];
-  chksumfile_cvt2string(chksum2, chksumstring);
-  int size = inode_getsize(&in);
-  fprintf(f, "Path %s %d mode 0x%x size %d checksum %s\n",pathname,inumber,in.i_mode, size, chksumstring);
-
-  if (pathname[1] == 0) {
-    /* pathame == "/" */
-    pathname++; /* Delete extra / character */
+  struct sectorcache_stats stats;
+  if (!quietFlag && diskimg_getcachestats(fd, &stats) == 0) {
+    fprintf(stderr, "Sector cache %llu hits %llu misses %llu evictions\n",
+            (unsigned long long) stats.hits, (unsigned long long) stats.misses,
+            (unsigned long long) stats.evictions);
   }
 
-  if ((in.i_mode & IFMT) == IFDIR) { 
-      const unsigned int MAXPATH = 1024;
-      if (strlen(pathname) > MAXPATH-16) {
-        fprintf(stderr, "Too deep of directories %s\n", pathname);
-      }
-
-      struct direntv6 direntries[10000];
-      int numentries = GetDirEntries(fs, inumber, direntries, 10000);
-      for (int i = 0; i < numentries; i++) {
-        char *n =  direntries[i].d_name;
-        if (n[0] == '.') {
-          if ((n[1] == 0) || ((n[1] == '.') && (n[2] == 0))) {
-            /* Skip over "." and ".." */
-            continue;
-          }
-        }
+  if (tracePath != NULL) iostats_print(fs->iostats, stderr);
 
-        char nextpath[MAXPATH];
-        sprintf(nextpath, "%s/%s",pathname, direntries[i].d_name);
-        DumpPathAndChildren(fs, nextpath,  direntries[i].d_inumber, f);
-      }
-  }
-}
-
-/**
- * Output to the specified file the checksum of files on the disk by
- * tranversing the naming hierarcy. 
- * Note this is used by the grading script so don't alter output format. 
- */
-static void DumpPathnameChecksum(struct unixfilesystem *fs, FILE *f) {
-  DumpPathAndChildren(fs, "/", ROOT_INUMBER, f);
+  unixfilesystem_free(fs);
+  int err = diskimg_close(fd);
+  if (err < 0) fprintf(stderr, "Error closing %s\n", argv[1]);
+  exit(EXIT_SUCCESS);
+  return 0;
 }
 
 /**
@@ -203,64 +179,54 @@ static void PrintDirectory(struct unixfilesystem *fs,  char *pathname) {
     return;
   }
 
-  struct direntv6 direntries[10000];
-  int numentries = GetDirEntries(fs, inumber, direntries, 10000);
-  if (numentries < 0) {
+  struct directory_iter it;
+  if (directory_open(fs, inumber, &it) < 0) {
     fprintf(stderr, "Can't read entries from %s\n", pathname);
     return;
   }
-  
-  for (int i = 0; i < numentries; i++) { 
-    printf("Direntry %s Name %s Inumber %d\n", pathname, direntries[i].d_name, direntries[i].d_inumber);
+
+  const struct direntv6 *dir;
+  int err;
+  while ((err = directory_next(&it, &dir)) > 0) {
+    printf("Direntry %s Name %.*s Inumber %d\n", pathname, (int) sizeof(dir->d_name), dir->d_name, dir->d_inumber);
+  }
+  if (err < 0) {
+    fprintf(stderr, "Can't read entries from %s\n", pathname);
   }
+  directory_close(&it);
 }
 
 /**
- * Fetch as many entries from a directory that will fit in the specified array. Return the 
- * number of entries found. 
+ * Summarizes the free list: how much space is free and how fragmented it is.
  */
-static int GetDirEntries(struct unixfilesystem *fs, int inumber, struct direntv6 *entries, int maxNumEntries) {
-  struct inode in;
-  int err = inode_iget(fs, inumber, &in);
-  if (err < 0) return err;
-  
-  if (!(in.i_mode & IALLOC) || ((in.i_mode & IFMT) != IFDIR)) {
-    /* Not allocated or not a directory */
-    return -1;
-  }
-
-  if (maxNumEntries < 1) return -1;
-  int size = inode_getsize(&in);
-
-  assert((size % sizeof(struct direntv6)) == 0);
-
-  int count = 0;
-  int numBlocks  = (size + DISKIMG_SECTOR_SIZE - 1) / DISKIMG_SECTOR_SIZE;
-  char buf[DISKIMG_SECTOR_SIZE];
-  struct direntv6 *dir = (struct direntv6 *) buf;
-  for (int bno = 0; bno < numBlocks; bno++) {
-    int bytesLeft, numEntriesInBlock, i;
-    bytesLeft = file_getblock(fs, inumber,bno,dir);
-    if (bytesLeft < 0) {
-      fprintf(stderr, "Error reading directory\n");
-      return -1;
-    }
-    numEntriesInBlock = bytesLeft/sizeof(struct direntv6); 
-    for (i = 0; i <  numEntriesInBlock ; i++) { 
-      entries[count] = dir[i];
-      count++;
-      if (count >= maxNumEntries) return count;
-    }
+static void PrintFreeSpace(struct unixfilesystem *fs) {
+  struct freemap *map = freemap_build(fs);
+  if (map == NULL) {
+    fprintf(stderr, "Can't read the free list\n");
+    return;
   }
-  return count;
+  struct freemap_stats stats;
+  freemap_getstats(map, &stats);
+  printf("Free space %d blocks (%d KB) in %d runs, longest %d blocks at block %d\n", stats.numFree,
+         stats.numFree * DISKIMG_SECTOR_SIZE / 1024, stats.numRuns, stats.longestRun, stats.longestRunStart);
+  freemap_free(map);
 }
 
-
 static void PrintUsageAndExit(char *progname) {
   fprintf(stderr, "Usage: %s <options> diskimagePath\n", progname);
   fprintf(stderr, "where <options> can be:\n");
   fprintf(stderr, "-q     don't print extra info\n"); 
   fprintf(stderr, "-i     print all inode checksums\n"); 
   fprintf(stderr, "-p     print all pathname checksums\n");  
+  fprintf(stderr, "-c N   cache up to N disk sectors in memory\n");
+  fprintf(stderr, "-l     evict cached sectors in LRU order instead of CLOCK\n");
+  fprintf(stderr, "-m     memory map the disk image instead of reading it sector by sector\n");
+  fprintf(stderr, "-t     load the whole inode table into memory up front\n");
+  fprintf(stderr, "-r     prefetch ahead of files being read sequentially\n");
+  fprintf(stderr, "-j N   use N threads for the dumps\n");
+  fprintf(stderr, "-s F   reuse the checksums of unchanged files recorded in manifest F, and update it\n");
+  fprintf(stderr, "-T N   print tree hashes, computed with N threads per file, instead of checksums (not with -s)\n");
+  fprintf(stderr, "-F     print a summary of the free space\n");
+  fprintf(stderr, "-I F   write a trace of every sector access to F and print I/O counts by call site\n");
   exit(EXIT_FAILURE);
 }
@@ -0,0 +1,405 @@
+#include "diskimg.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define JOURNAL_MAGIC 0x56364a4e  // "V6JN"
+
+/**
+ * Header of the redo journal record.  It is followed by numSectors sector
+ * numbers (int32_t) and then the contents of those sectors; checksum covers
+ * both.
+ */
+struct journalheader {
+  uint32_t magic;
+  uint32_t numSectors;
+  uint64_t checksum;
+};
+
+/**
+ * Per-image state, indexed by file descriptor.  diskimg_open() creates it.
+ */
+struct diskimg {
+  struct sectorcache *cache;
+  char *map;         // read-only mapping of the whole image, or NULL
+  off_t mapSize;
+  int writeback;     // writes stay in the cache until diskimg_flush()
+  int journalFd;     // redo journal used by diskimg_flush()
+  struct diskimg_iostats stats;  // updated atomically, reads may be concurrent
+  diskimg_observer observer;     // told about every access, or NULL
+  void *observerArg;
+};
+
+static struct diskimg **images = NULL;
+static int numImages = 0;
+
+// Returns the state for fd, allocating it if create is set.
+static struct diskimg *diskimg_lookup(int fd, int create) {
+  if (fd < 0) return NULL;
+  if (fd >= numImages) {
+    if (!create) return NULL;
+    struct diskimg **grown = realloc(images, (fd + 1) * sizeof(struct diskimg *));
+    if (grown == NULL) return NULL;
+    for (int i = numImages; i <= fd; i++) grown[i] = NULL;
+    images = grown;
+    numImages = fd + 1;
+  }
+  if (images[fd] == NULL && create) {
+    images[fd] = calloc(1, sizeof(struct diskimg));
+  }
+  return images[fd];
+}
+
+// Counts a read call that returned bytesRead bytes starting at sectorNum,
+// using numSyscalls system calls, and tells the observer.
+static void count_read(struct diskimg *img, int sectorNum, int bytesRead, int numSyscalls, int source) {
+  if (img == NULL) return;
+  int numSectors = (bytesRead > 0) ? (bytesRead + DISKIMG_SECTOR_SIZE - 1) / DISKIMG_SECTOR_SIZE : 0;
+  __atomic_fetch_add(&img->stats.reads, 1, __ATOMIC_RELAXED);
+  if (numSectors > 0) __atomic_fetch_add(&img->stats.sectors, numSectors, __ATOMIC_RELAXED);
+  if (numSyscalls > 0) __atomic_fetch_add(&img->stats.syscalls, numSyscalls, __ATOMIC_RELAXED);
+  if (img->observer != NULL && numSectors > 0) {
+    img->observer(img->observerArg, DISKIMG_OP_READ, sectorNum, numSectors, source);
+  }
+}
+
+// Copies a sector out of the mapping.  Like read(), returns a short count for
+// a sector that runs past the end of the image.
+static int map_readsector(struct diskimg *img, int sectorNum, void *buf) {
+  off_t offset = (off_t) sectorNum * DISKIMG_SECTOR_SIZE;
+  if (sectorNum < 0) return -1;
+  if (offset >= img->mapSize) return 0;
+  int len = (img->mapSize - offset < DISKIMG_SECTOR_SIZE) ? img->mapSize - offset : DISKIMG_SECTOR_SIZE;
+  memcpy(buf, img->map + offset, len);
+  return len;
+}
+
+// Write-back images: copies dirty cached sectors over the stale contents just
+// read from the disk into the buffers described by iov.
+static void overlay_dirty(struct diskimg *img, int sectorNum, const struct iovec *iov, int iovcnt, size_t bytesRead) {
+  if (!img->writeback || sectorcache_numdirty(img->cache) == 0) return;
+  size_t done = 0;
+  for (int i = 0; i < iovcnt && done < bytesRead; i++) {
+    for (size_t off = 0; off + DISKIMG_SECTOR_SIZE <= iov[i].iov_len && done + off < bytesRead; off += DISKIMG_SECTOR_SIZE) {
+      sectorcache_lookupdirty(img->cache, sectorNum + (done + off) / DISKIMG_SECTOR_SIZE,
+                              (char *) iov[i].iov_base + off);
+    }
+    done += iov[i].iov_len;
+  }
+}
+
+// FNV-1a over a journal record's sector numbers and contents.
+static uint64_t journal_checksum(const int32_t *sectorNums, const char *data, int numSectors) {
+  uint64_t h = 14695981039346656037ull;
+  const unsigned char *p = (const unsigned char *) sectorNums;
+  for (size_t i = 0; i < numSectors * sizeof(int32_t); i++) h = (h ^ p[i]) * 1099511628211ull;
+  p = (const unsigned char *) data;
+  for (size_t i = 0; i < (size_t) numSectors * DISKIMG_SECTOR_SIZE; i++) h = (h ^ p[i]) * 1099511628211ull;
+  return h;
+}
+
+// Writes each run of consecutive sectors with one system call.
+static int write_runs(int fd, const int32_t *sectorNums, const char *data, int numSectors) {
+  int start = 0;
+  while (start < numSectors) {
+    int len = 1;
+    while (start + len < numSectors && sectorNums[start + len] == sectorNums[start] + len) len++;
+    size_t bytes = (size_t) len * DISKIMG_SECTOR_SIZE;
+    const char *src = data + (size_t) start * DISKIMG_SECTOR_SIZE;
+    off_t offset = (off_t) sectorNums[start] * DISKIMG_SECTOR_SIZE;
+    size_t done = 0;
+    while (done < bytes) {
+      ssize_t n = pwrite(fd, src + done, bytes - done, offset + done);
+      if (n <= 0) return -1;
+      done += n;
+    }
+    start += len;
+  }
+  return 0;
+}
+
+// Applies a complete journal record left behind by an interrupted flush, then
+// empties the journal.  A torn record is dropped: the image was not touched
+// before the record was complete.
+static int replay_journal(int fd, int journalFd) {
+  struct journalheader hdr;
+  int err = 0;
+  if (pread(journalFd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && hdr.magic == JOURNAL_MAGIC &&
+      hdr.numSectors > 0 && hdr.numSectors <= INT32_MAX / DISKIMG_SECTOR_SIZE) {
+    size_t numsBytes = hdr.numSectors * sizeof(int32_t);
+    size_t dataBytes = (size_t) hdr.numSectors * DISKIMG_SECTOR_SIZE;
+    int32_t *sectorNums = malloc(numsBytes);
+    char *data = malloc(dataBytes);
+    if (sectorNums == NULL || data == NULL) {
+      err = -1;
+    } else if (pread(journalFd, sectorNums, numsBytes, sizeof(hdr)) == (ssize_t) numsBytes &&
+               pread(journalFd, data, dataBytes, sizeof(hdr) + numsBytes) == (ssize_t) dataBytes &&
+               journal_checksum(sectorNums, data, hdr.numSectors) == hdr.checksum) {
+      if (write_runs(fd, sectorNums, data, hdr.numSectors) < 0 || fdatasync(fd) < 0) err = -1;
+    }
+    free(sectorNums);
+    free(data);
+  }
+  if (err == 0 && (ftruncate(journalFd, 0) < 0 || fdatasync(journalFd) < 0)) err = -1;
+  return err;
+}
+
+int diskimg_open(char *pathname, int readOnly) {
+  int fd = open(pathname, readOnly ? O_RDONLY : O_RDWR);
+  if (fd >= 0 && diskimg_lookup(fd, 1) == NULL) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int diskimg_getsize(int fd) {
+  return lseek(fd, 0, SEEK_END);
+}
+
+int diskimg_readsector(int fd, int sectorNum, void *buf) {
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  if (img != NULL && img->map != NULL) {
+    int bytesRead = map_readsector(img, sectorNum, buf);
+    count_read(img, sectorNum, bytesRead, 0, DISKIMG_FROM_MAP);
+    return bytesRead;
+  }
+  if (img != NULL && img->cache != NULL && sectorcache_lookup(img->cache, sectorNum, buf)) {
+    count_read(img, sectorNum, DISKIMG_SECTOR_SIZE, 0, DISKIMG_FROM_CACHE);
+    return DISKIMG_SECTOR_SIZE;
+  }
+
+  int bytesRead = pread(fd, buf, DISKIMG_SECTOR_SIZE, (off_t) sectorNum * DISKIMG_SECTOR_SIZE);
+  count_read(img, sectorNum, bytesRead, 1, DISKIMG_FROM_DISK);
+  if (bytesRead == DISKIMG_SECTOR_SIZE && img != NULL && img->cache != NULL) {
+    sectorcache_fill(img->cache, sectorNum, buf);
+  }
+  return bytesRead;
+}
+
+int diskimg_readsectors(int fd, int sectorNum, int numSectors, void *buf) {
+  if (sectorNum < 0 || numSectors < 0) return -1;
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  off_t offset = (off_t) sectorNum * DISKIMG_SECTOR_SIZE;
+  size_t len = (size_t) numSectors * DISKIMG_SECTOR_SIZE;
+  if (img != NULL && img->map != NULL) {
+    if (offset >= img->mapSize) return 0;
+    if (offset + (off_t) len > img->mapSize) len = img->mapSize - offset;
+    memcpy(buf, img->map + offset, len);
+    count_read(img, sectorNum, len, 0, DISKIMG_FROM_MAP);
+    return len;
+  }
+
+  size_t done = 0;
+  int numSyscalls = 0;
+  while (done < len) {
+    ssize_t n = pread(fd, (char *) buf + done, len - done, offset + done);
+    numSyscalls++;
+    if (n < 0) {
+      count_read(img, sectorNum, -1, numSyscalls, DISKIMG_FROM_DISK);
+      return -1;
+    }
+    if (n == 0) break;
+    done += n;
+  }
+  count_read(img, sectorNum, done, numSyscalls, DISKIMG_FROM_DISK);
+  if (img != NULL) {
+    struct iovec iov = { buf, len };
+    overlay_dirty(img, sectorNum, &iov, 1, done);
+  }
+  return done;
+}
+
+int diskimg_readv(int fd, int sectorNum, const struct iovec *iov, int iovcnt) {
+  if (sectorNum < 0 || iovcnt < 0) return -1;
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  off_t offset = (off_t) sectorNum * DISKIMG_SECTOR_SIZE;
+  if (img != NULL && img->map != NULL) {
+    size_t done = 0;
+    for (int i = 0; i < iovcnt && offset + (off_t) done < img->mapSize; i++) {
+      size_t len = iov[i].iov_len;
+      if (offset + (off_t) (done + len) > img->mapSize) len = img->mapSize - offset - done;
+      memcpy(iov[i].iov_base, img->map + offset + done, len);
+      done += len;
+    }
+    count_read(img, sectorNum, done, 0, DISKIMG_FROM_MAP);
+    return done;
+  }
+  ssize_t bytesRead = preadv(fd, iov, iovcnt, offset);
+  count_read(img, sectorNum, bytesRead, 1, DISKIMG_FROM_DISK);
+  if (bytesRead > 0 && img != NULL) overlay_dirty(img, sectorNum, iov, iovcnt, bytesRead);
+  return bytesRead;
+}
+
+int diskimg_writesector(int fd, int sectorNum, void *buf) {
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  if (img != NULL && img->writeback) {
+    if (sectorNum < 0) return -1;
+    if (sectorcache_write(img->cache, sectorNum, buf) < 0) {
+      // Every slot is dirty; make room.
+      if (diskimg_flush(fd) < 0 || sectorcache_write(img->cache, sectorNum, buf) < 0) return -1;
+    }
+    if (img->observer != NULL) img->observer(img->observerArg, DISKIMG_OP_WRITE, sectorNum, 1, DISKIMG_FROM_CACHE);
+    return DISKIMG_SECTOR_SIZE;
+  }
+
+  // The mapping is shared, so it sees the write without any help.
+  int bytesWritten = pwrite(fd, buf, DISKIMG_SECTOR_SIZE, (off_t) sectorNum * DISKIMG_SECTOR_SIZE);
+  if (bytesWritten == DISKIMG_SECTOR_SIZE && img != NULL && img->cache != NULL) {
+    sectorcache_insert(img->cache, sectorNum, buf);
+  }
+  if (bytesWritten == DISKIMG_SECTOR_SIZE && img != NULL && img->observer != NULL) {
+    img->observer(img->observerArg, DISKIMG_OP_WRITE, sectorNum, 1, DISKIMG_FROM_DISK);
+  }
+  return bytesWritten;
+}
+
+int diskimg_close(int fd) {
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  int err = 0;
+  if (img != NULL) {
+    if (img->writeback) {
+      err = diskimg_flush(fd);
+      close(img->journalFd);
+    }
+    sectorcache_free(img->cache);
+    if (img->map != NULL) munmap(img->map, img->mapSize);
+    free(img);
+    images[fd] = NULL;
+  }
+  if (close(fd) < 0) err = -1;
+  return err;
+}
+
+int diskimg_setcache(int fd, int numSlots, int policy) {
+  if (numSlots < 0) return -1;
+  struct diskimg *img = diskimg_lookup(fd, numSlots > 0);
+  if (img == NULL) return (numSlots == 0) ? 0 : -1;
+  if (img->writeback && (numSlots == 0 || diskimg_flush(fd) < 0)) return -1;
+
+  struct sectorcache *cache = NULL;
+  if (numSlots > 0) {
+    cache = sectorcache_create(numSlots, policy);
+    if (cache == NULL) return -1;
+  }
+  sectorcache_free(img->cache);
+  img->cache = cache;
+  return 0;
+}
+
+int diskimg_getcachestats(int fd, struct sectorcache_stats *stats) {
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  if (img == NULL || img->cache == NULL) return -1;
+  sectorcache_getstats(img->cache, stats);
+  return 0;
+}
+
+int diskimg_getiostats(int fd, struct diskimg_iostats *stats) {
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  if (img == NULL) return -1;
+  stats->reads = __atomic_load_n(&img->stats.reads, __ATOMIC_RELAXED);
+  stats->sectors = __atomic_load_n(&img->stats.sectors, __ATOMIC_RELAXED);
+  stats->syscalls = __atomic_load_n(&img->stats.syscalls, __ATOMIC_RELAXED);
+  return 0;
+}
+
+int diskimg_setobserver(int fd, diskimg_observer observer, void *arg) {
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  if (img == NULL) return -1;
+  img->observer = observer;
+  img->observerArg = arg;
+  return 0;
+}
+
+int diskimg_mmap(int fd) {
+  struct diskimg *img = diskimg_lookup(fd, 1);
+  if (img == NULL || img->writeback) return -1;
+  if (img->map != NULL) return 0;
+
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (size <= 0) return -1;
+  void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) return -1;
+  img->map = map;
+  img->mapSize = size;
+  return 0;
+}
+
+const void *diskimg_sectorref(int fd, int sectorNum, void *buf) {
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  if (img != NULL && img->map != NULL && sectorNum >= 0 &&
+      (off_t) (sectorNum + 1) * DISKIMG_SECTOR_SIZE <= img->mapSize) {
+    count_read(img, sectorNum, DISKIMG_SECTOR_SIZE, 0, DISKIMG_FROM_MAP);
+    return img->map + (off_t) sectorNum * DISKIMG_SECTOR_SIZE;
+  }
+  if (diskimg_readsector(fd, sectorNum, buf) != DISKIMG_SECTOR_SIZE) return NULL;
+  return buf;
+}
+
+int diskimg_prefetch(int fd, int sectorNum, int numSectors) {
+  if (sectorNum < 0 || numSectors <= 0) return -1;
+  off_t offset = (off_t) sectorNum * DISKIMG_SECTOR_SIZE;
+  off_t len = (off_t) numSectors * DISKIMG_SECTOR_SIZE;
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  if (img != NULL && img->map != NULL) {
+    if (offset >= img->mapSize) return 0;
+    if (len > img->mapSize - offset) len = img->mapSize - offset;
+    // madvise wants a page aligned start.
+    off_t pageSize = sysconf(_SC_PAGESIZE);
+    off_t start = offset - offset % pageSize;
+    return madvise(img->map + start, len + (offset - start), MADV_WILLNEED);
+  }
+  return (posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED) == 0) ? 0 : -1;
+}
+
+int diskimg_setwriteback(int fd, const char *journalPath) {
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  if (img == NULL || img->cache == NULL || img->map != NULL) return -1;
+  if (img->writeback) return 0;
+
+  int journalFd = open(journalPath, O_RDWR | O_CREAT, 0644);
+  if (journalFd < 0) return -1;
+  if (replay_journal(fd, journalFd) < 0) {
+    close(journalFd);
+    return -1;
+  }
+  img->journalFd = journalFd;
+  img->writeback = 1;
+  return 0;
+}
+
+int diskimg_flush(int fd) {
+  struct diskimg *img = diskimg_lookup(fd, 0);
+  if (img == NULL || !img->writeback) return 0;
+  int numSectors = sectorcache_numdirty(img->cache);
+  if (numSectors == 0) return 0;
+
+  int32_t *sectorNums = malloc(numSectors * sizeof(int32_t));
+  char *data = malloc((size_t) numSectors * DISKIMG_SECTOR_SIZE);
+  int err = -1;
+  if (sectorNums == NULL || data == NULL) goto out;
+  numSectors = sectorcache_getdirty(img->cache, numSectors, sectorNums, data);
+
+  // Commit the whole batch to the journal before touching the image, so a
+  // crash at any point leaves either the old image or a record to redo.
+  struct journalheader hdr = { JOURNAL_MAGIC, numSectors, journal_checksum(sectorNums, data, numSectors) };
+  struct iovec iov[3] = {
+    { &hdr, sizeof(hdr) },
+    { sectorNums, numSectors * sizeof(int32_t) },
+    { data, (size_t) numSectors * DISKIMG_SECTOR_SIZE },
+  };
+  ssize_t recordSize = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+  if (pwritev(img->journalFd, iov, 3, 0) != recordSize || fdatasync(img->journalFd) < 0) goto out;
+
+  if (write_runs(fd, sectorNums, data, numSectors) < 0 || fdatasync(fd) < 0) goto out;
+  if (ftruncate(img->journalFd, 0) < 0 || fdatasync(img->journalFd) < 0) goto out;
+  sectorcache_markclean(img->cache, sectorNums, numSectors);
+  err = 0;
+
+out:
+  free(sectorNums);
+  free(data);
+  return err;
+}
@@ -2,10 +2,27 @@
 #define _DISKIMG_H_
 
 #include <stdint.h>
+#include <sys/uio.h>
+#include "sectorcache.h"
 
 // Size of a disk sector (e.g. block) in bytes.
 #define DISKIMG_SECTOR_SIZE 512
 
+struct diskimg_iostats {
+  uint64_t reads;     // read calls, of any of the diskimg_read*() functions or diskimg_sectorref()
+  uint64_t sectors;   // sectors they returned, whether from the disk, the cache or the mapping
+  uint64_t syscalls;  // system calls they issued to read the disk
+};
+
+// Kinds of access and where they were served from, as told to an observer.
+#define DISKIMG_OP_READ    0
+#define DISKIMG_OP_WRITE   1
+#define DISKIMG_FROM_DISK  0   // a system call on the image
+#define DISKIMG_FROM_CACHE 1   // the sector cache; also write-back writes
+#define DISKIMG_FROM_MAP   2   // the memory mapping
+
+typedef void (*diskimg_observer)(void *arg, int op, int sectorNum, int numSectors, int source);
+
 /**
  * Opens a disk image for I/O. Returns an open file descriptor, or -1 if
  * unsuccessful.  
@@ -23,16 +40,104 @@ int diskimg_getsize(int fd);
  */
 int diskimg_readsector(int fd, int sectorNum, void *buf); 
 
+/**
+ * Reads numSectors consecutive sectors starting at sectorNum into buf using as
+ * few system calls as possible.  Returns the number of bytes read, or -1 on
+ * error.
+ */
+int diskimg_readsectors(int fd, int sectorNum, int numSectors, void *buf);
+
+/**
+ * Reads consecutive sectors starting at sectorNum into the iovcnt buffers
+ * described by iov, filling each before moving on to the next, with a single
+ * system call.  Buffer lengths should be multiples of DISKIMG_SECTOR_SIZE.
+ * Returns the number of bytes read, or -1 on error.
+ */
+int diskimg_readv(int fd, int sectorNum, const struct iovec *iov, int iovcnt);
+
 /**
  * Writes the specified sector from the disk.  Returns the number of bytes
- * written, or -1 on error.
+ * written, or -1 on error.  On a write-back image the sector only goes to the
+ * cache; see diskimg_setwriteback().
  */
 int diskimg_writesector(int fd, int sectorNum, void *buf); 
 
 /**
- * Clean up from a previous diskimg_open() call.  Returns 0 on success, or -1 on
- * error.
+ * Clean up from a previous diskimg_open() call, flushing a write-back image
+ * first.  Returns 0 on success, or -1 on error.
  */
 int diskimg_close(int fd);
 
+/**
+ * Attaches a cache of numSlots sectors to an open disk image.  Later
+ * diskimg_readsector() calls on fd are served from the cache when possible and
+ * writes update the cached copy.  policy is SECTORCACHE_CLOCK or
+ * SECTORCACHE_LRU.  A numSlots of 0 removes the cache.  Returns 0 on success,
+ * or -1 on error.
+ */
+int diskimg_setcache(int fd, int numSlots, int policy);
+
+/**
+ * Fetches the hit/miss/eviction counters of the cache attached to fd.  Returns
+ * 0 on success, or -1 if fd has no cache.
+ */
+int diskimg_getcachestats(int fd, struct sectorcache_stats *stats);
+
+/**
+ * Fetches the read counters of fd, which count from diskimg_open().  Returns 0
+ * on success, or -1 if fd wasn't opened with diskimg_open().
+ */
+int diskimg_getiostats(int fd, struct diskimg_iostats *stats);
+
+/**
+ * Has observer(arg, ...) called after every successful read or write of
+ * numSectors sectors starting at sectorNum on fd, from the thread that made
+ * it.  A NULL observer stops the calls.  Must not be changed while other
+ * threads are using fd.  Returns 0 on success, or -1 if fd wasn't opened
+ * with diskimg_open().
+ */
+int diskimg_setobserver(int fd, diskimg_observer observer, void *arg);
+
+/**
+ * Maps the whole disk image read-only into memory.  Later reads on fd copy out
+ * of the mapping instead of issuing a system call per sector.  Returns 0 on
+ * success, or -1 on error.
+ */
+int diskimg_mmap(int fd);
+
+/**
+ * Returns a pointer to the contents of the specified sector.  If the image is
+ * memory mapped the pointer is into the mapping and nothing is copied;
+ * otherwise the sector is read into buf, which must hold DISKIMG_SECTOR_SIZE
+ * bytes, and buf is returned.  The contents must not be modified through the
+ * returned pointer.  Returns NULL on error or if the sector is not complete.
+ */
+const void *diskimg_sectorref(int fd, int sectorNum, void *buf);
+
+/**
+ * Tells the kernel that numSectors sectors starting at sectorNum will be read
+ * soon, so it can start fetching them in the background.  Never blocks on the
+ * disk.  Returns 0 on success, or -1 on error.
+ */
+int diskimg_prefetch(int fd, int sectorNum, int numSectors);
+
+/**
+ * Switches fd, which must have a cache and must not be memory mapped, to
+ * write-back mode: diskimg_writesector() only updates the cache, and dirty
+ * sectors reach the image when diskimg_flush() is called, when the cache has
+ * no clean slot left, or on diskimg_close().  Flushes go through a redo
+ * journal kept in the file journalPath (e.g. the image path plus
+ * ".journal").  If a previous flush was interrupted, the journal is replayed
+ * here first.  Returns 0 on success, or -1 on error.
+ */
+int diskimg_setwriteback(int fd, const char *journalPath);
+
+/**
+ * Writes all dirty sectors of a write-back image out in one batch: they are
+ * sorted, committed to the journal, then written to the image with one
+ * system call per run of consecutive sectors, and the journal is emptied.
+ * Does nothing for other images.  Returns 0 on success, or -1 on error.
+ */
+int diskimg_flush(int fd);
+
 #endif // _DISKIMG_H_
@@ -0,0 +1,617 @@
+#include "dump.h"
+#include "diskimg.h"
+#include "inode.h"
+#include "directory.h"
+#include "pathname.h"
+#include "chksumfile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+// Inodes claimed at a time by a worker of the parallel inode dump.
+#define INODE_CHUNK 256
+
+/**
+ * Checksums an inode or a pathname with the linear checksum, or the tree hash
+ * if options->treeThreads is set.
+ */
+static int ChecksumInode(struct unixfilesystem *fs, const struct dump_options *options, int inumber, void *chksum) {
+  if (options->treeThreads > 0) return chksumfile_treebyinumber(fs, inumber, chksum, options->treeThreads);
+  return chksumfile_byinumber(fs, inumber, chksum);
+}
+
+static int ChecksumPath(struct unixfilesystem *fs, const struct dump_options *options, const char *pathname,
+                        void *chksum) {
+  if (options->treeThreads > 0) {
+    int inumber = pathname_lookup(fs, pathname);
+    if (inumber < 0) return inumber;
+    return chksumfile_treebyinumber(fs, inumber, chksum, options->treeThreads);
+  }
+  return chksumfile_bypathname(fs, pathname, chksum);
+}
+
+/**
+ * Output to the specified file the checksum of inode inumber, whose contents
+ * are in, if it is allocated.  Returns -1 if it can't be checksummed.
+ */
+static int DumpOneInode(struct unixfilesystem *fs, const struct dump_options *options, int inumber,
+                        const struct inode *in, FILE *f) {
+  if ((in->i_mode & IALLOC) == 0) {
+    // Skip this inode if it's not allocated.
+    return 0;
+  }
+
+  char chksum[CHKSUMFILE_SIZE];
+  if (ChecksumInode(fs, options, inumber, chksum) < 0) {
+    fprintf(stderr, "Inode %d can't compute chksum\n", inumber);
+    return -1;
+  }
+
+  char chksumstring[CHKSUMFILE_STRINGSIZE];
+  chksumfile_cvt2string(chksum, chksumstring);
+
+  int size = inode_getsize(in);
+  fprintf(f, "Inode %d mode 0x%x size %d checksum %s\n",inumber,in->i_mode, size, chksumstring);
+  return 0;
+}
+
+/**
+ * Output to the specified file the checksums of the allocated inodes among
+ * [first, end), fetching them INODE_CHUNK at a time, and adds the number that
+ * couldn't be dumped to *errors.  Returns -1 if an inode can't be read, which
+ * ends the dump, and 0 otherwise.
+ */
+static int DumpInodeRange(struct unixfilesystem *fs, const struct dump_options *options, int first, int end,
+                          FILE *f, int *errors) {
+  int inumbers[INODE_CHUNK];
+  struct inode inodes[INODE_CHUNK];
+  for (int start = first; start < end; start += INODE_CHUNK) {
+    int n = (end - start < INODE_CHUNK) ? end - start : INODE_CHUNK;
+    for (int i = 0; i < n; i++) {
+      inumbers[i] = start + i;
+    }
+    if (inode_iget_batch(fs, inumbers, n, inodes) == 0) {
+      for (int i = 0; i < n; i++) {
+        if (DumpOneInode(fs, options, start + i, &inodes[i], f) < 0) (*errors)++;
+      }
+      continue;
+    }
+
+    // Go one by one to dump everything before the inode that can't be read.
+    for (int i = 0; i < n; i++) {
+      if (inode_iget(fs, start + i, &inodes[i]) < 0) {
+        fprintf(stderr,"Can't read inode %d \n", start + i);
+        (*errors)++;
+        return -1;
+      }
+      if (DumpOneInode(fs, options, start + i, &inodes[i], f) < 0) (*errors)++;
+    }
+  }
+  return 0;
+}
+
+/**
+ * State shared by the threads of a parallel inode dump.  The inumbers are
+ * split into chunks of INODE_CHUNK that workers claim in order; each chunk's
+ * output is collected in memory and printed by the main thread once every
+ * chunk before it has been printed, so the output matches a serial dump.
+ */
+struct inodechunk {
+  char *output;
+  size_t outputLen;
+  int errors;        // inodes of this chunk that couldn't be dumped
+  int stopped;       // an inode in this chunk couldn't be read
+  int done;
+};
+
+struct inodescan {
+  struct unixfilesystem *fs;
+  const struct dump_options *options;
+  int endInumber;    // one past the last inumber to dump
+  int numChunks;
+  struct inodechunk *chunks;
+  int nextChunk;
+  int stop;          // set once a chunk has stopped; no more chunks are claimed
+  pthread_mutex_t lock;
+  pthread_cond_t chunkDone;
+};
+
+static void *InodeScanWorker(void *arg) {
+  struct inodescan *scan = arg;
+  while (1) {
+    pthread_mutex_lock(&scan->lock);
+    int c = scan->stop ? scan->numChunks : scan->nextChunk++;
+    pthread_mutex_unlock(&scan->lock);
+    if (c >= scan->numChunks) return NULL;
+
+    struct inodechunk *chunk = &scan->chunks[c];
+    FILE *out = open_memstream(&chunk->output, &chunk->outputLen);
+    int stopped = (out == NULL);
+    int errors = stopped;
+    int first = 1 + c * INODE_CHUNK;
+    int end = (first + INODE_CHUNK < scan->endInumber) ? first + INODE_CHUNK : scan->endInumber;
+    if (!stopped) stopped = DumpInodeRange(scan->fs, scan->options, first, end, out, &errors) < 0;
+    if (out != NULL) fclose(out);
+
+    pthread_mutex_lock(&scan->lock);
+    chunk->errors = errors;
+    chunk->stopped = stopped;
+    chunk->done = 1;
+    if (stopped) scan->stop = 1;
+    pthread_cond_broadcast(&scan->chunkDone);
+    pthread_mutex_unlock(&scan->lock);
+  }
+}
+
+static int DumpInodesParallel(struct unixfilesystem *fs, const struct dump_options *options, FILE *f) {
+  struct inodescan scan;
+  scan.fs = fs;
+  scan.options = options;
+  scan.endInumber = fs->superblock.s_isize*16;
+  scan.numChunks = (scan.endInumber - 1 + INODE_CHUNK - 1) / INODE_CHUNK;
+  scan.chunks = calloc(scan.numChunks > 0 ? scan.numChunks : 1, sizeof(struct inodechunk));
+  scan.nextChunk = 0;
+  scan.stop = 0;
+  pthread_mutex_init(&scan.lock, NULL);
+  pthread_cond_init(&scan.chunkDone, NULL);
+  if (scan.chunks == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+
+  pthread_t threads[options->numThreads];
+  int numStarted = 0;
+  while (numStarted < options->numThreads &&
+         pthread_create(&threads[numStarted], NULL, InodeScanWorker, &scan) == 0) {
+    numStarted++;
+  }
+  if (numStarted == 0) {
+    // Couldn't start any workers, so do the whole scan on this thread.
+    InodeScanWorker(&scan);
+  }
+
+  int errors = 0;
+  for (int c = 0; c < scan.numChunks; c++) {
+    struct inodechunk *chunk = &scan.chunks[c];
+    pthread_mutex_lock(&scan.lock);
+    while (!chunk->done) pthread_cond_wait(&scan.chunkDone, &scan.lock);
+    pthread_mutex_unlock(&scan.lock);
+
+    fwrite(chunk->output, 1, chunk->outputLen, f);
+    free(chunk->output);
+    chunk->output = NULL;
+    errors += chunk->errors;
+    if (chunk->stopped) break;
+  }
+
+  for (int t = 0; t < numStarted; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  for (int c = 0; c < scan.numChunks; c++) {
+    // Chunks past one that stopped are never printed.
+    free(scan.chunks[c].output);
+  }
+  free(scan.chunks);
+  pthread_mutex_destroy(&scan.lock);
+  pthread_cond_destroy(&scan.chunkDone);
+  return errors > 0 ? -1 : 0;
+}
+
+int dump_inodes(struct unixfilesystem *fs, const struct dump_options *options, FILE *f) {
+  if (options->numThreads > 1) return DumpInodesParallel(fs, options, f);
+  int errors = 0;
+  DumpInodeRange(fs, options, 1, fs->superblock.s_isize*16, f, &errors);
+  return errors > 0 ? -1 : 0;
+}
+
+/**
+ * Output to the specified file the checksum of the specified pathname and
+ * inode, whose contents are in.  Returns 1 if the inode is a directory whose
+ * children should be dumped next, 0 if not, and -1 on error.
+ */
+static int DumpOnePath(struct unixfilesystem *fs, const struct dump_options *options, const char *pathname,
+                       int inumber, const struct inode *in, FILE *f) {
+  assert(in->i_mode & IALLOC);
+
+  char chksum1[CHKSUMFILE_SIZE];
+  if (ChecksumInode(fs, options, inumber, chksum1) < 0) {
+    fprintf(stderr,"Can't checksum inode %d path %s\n", inumber, pathname);
+    return -1;
+  }
+
+  char chksum2[CHKSUMFILE_SIZE];
+  if (ChecksumPath(fs, options, pathname, chksum2) < 0) {
+    fprintf(stderr,"Can't checksum inode %d path %s\n", inumber, pathname);
+    return -1;
+  }
+
+  if (!chksumfile_compare(chksum1, chksum2)) {
+    fprintf(stderr,"Pathname checksum of %s differs from inode %d\n", pathname, inumber);
+    return -1;
+  }
+
+  char chksumstring[CHKSUMFILE_STRINGSIZE];
+  chksumfile_cvt2string(chksum2, chksumstring);
+  int size = inode_getsize(in);
+  fprintf(f, "Path %s %d mode 0x%x size %d checksum %s\n",pathname,inumber,in->i_mode, size, chksumstring);
+
+  return (in->i_mode & IFMT) == IFDIR;
+}
+
+typedef void (*childvisitor)(const char *childpath, int childinumber, const struct inode *childinode, void *arg);
+
+// Children fetched together by ForEachChildPath, one directory block's worth.
+#define CHILD_BATCH (DISKIMG_SECTOR_SIZE / sizeof(struct direntv6))
+
+// Fetches the inodes of children[0..n) in one batch and visits them.  Returns
+// the number of children that couldn't be read.
+static int VisitChildren(struct unixfilesystem *fs, const char *pathname, const struct direntv6 *children,
+                         int n, childvisitor visit, void *arg) {
+  int inumbers[CHILD_BATCH];
+  struct inode inodes[CHILD_BATCH];
+  for (int i = 0; i < n; i++) {
+    inumbers[i] = children[i].d_inumber;
+  }
+  int batchErr = inode_iget_batch(fs, inumbers, n, inodes);
+
+  char childpath[strlen(pathname) + sizeof(children[0].d_name) + 2];
+  int errors = 0;
+  for (int i = 0; i < n; i++) {
+    if (batchErr < 0 && inode_iget(fs, inumbers[i], &inodes[i]) < 0) {
+      fprintf(stderr,"Can't read inode %d \n", inumbers[i]);
+      errors++;
+      continue;
+    }
+    sprintf(childpath, "%s/%.*s", pathname, (int) sizeof(children[i].d_name), children[i].d_name);
+    visit(childpath, inumbers[i], &inodes[i], arg);
+  }
+  return errors;
+}
+
+/**
+ * Calls visit with the full pathname, inumber and inode of every entry of the
+ * directory except "." and "..", in directory order.  The inodes are fetched
+ * a directory block at a time with inode_iget_batch.  Returns -1 if the
+ * directory or any child's inode couldn't be read, and 0 otherwise.
+ */
+static int ForEachChildPath(struct unixfilesystem *fs, const char *pathname, int inumber,
+                            childvisitor visit, void *arg) {
+  if (pathname[1] == 0) {
+    /* pathame == "/" */
+    pathname++; /* Delete extra / character */
+  }
+
+  const unsigned int MAXPATH = 1024;
+  if (strlen(pathname) > MAXPATH-16) {
+    fprintf(stderr, "Too deep of directories %s\n", pathname);
+  }
+
+  struct directory_iter it;
+  if (directory_open(fs, inumber, &it) < 0) return -1;
+  struct direntv6 children[CHILD_BATCH];
+  int numChildren = 0;
+  int errors = 0;
+  const struct direntv6 *dir;
+  int err;
+  while ((err = directory_next(&it, &dir)) > 0) {
+    const char *n = dir->d_name;
+    if (n[0] == '.') {
+      if ((n[1] == 0) || ((n[1] == '.') && (n[2] == 0))) {
+        /* Skip over "." and ".." */
+        continue;
+      }
+    }
+
+    children[numChildren++] = *dir;
+    if (numChildren == CHILD_BATCH) {
+      errors += VisitChildren(fs, pathname, children, numChildren, visit, arg);
+      numChildren = 0;
+    }
+  }
+  errors += VisitChildren(fs, pathname, children, numChildren, visit, arg);
+  if (err < 0) {
+    fprintf(stderr, "Error reading directory\n");
+    errors++;
+  }
+  directory_close(&it);
+  return errors > 0 ? -1 : 0;
+}
+
+struct serialdump {
+  struct unixfilesystem *fs;
+  const struct dump_options *options;
+  FILE *f;
+  int errors;
+};
+
+static void DumpPathAndChildren(struct serialdump *dump, const char *pathname, int inumber,
+                                const struct inode *in);
+
+static void DumpChildPath(const char *childpath, int childinumber, const struct inode *childinode, void *arg) {
+  DumpPathAndChildren(arg, childpath, childinumber, childinode);
+}
+
+/**
+ * Output to the dump's file the checksum of the specified pathname and
+ * inode as well as all its children if it is a directory.
+ */
+static void DumpPathAndChildren(struct serialdump *dump, const char *pathname, int inumber,
+                                const struct inode *in) {
+  int isdir = DumpOnePath(dump->fs, dump->options, pathname, inumber, in, dump->f);
+  if (isdir < 0) dump->errors++;
+  if (isdir > 0 && ForEachChildPath(dump->fs, pathname, inumber, DumpChildPath, dump) < 0) dump->errors++;
+}
+
+/**
+ * The parallel pathname dump.  Every path is a task; visiting a directory
+ * creates a task for each child.  Each worker keeps its own deque of tasks,
+ * taking new work from its bottom (depth first) and, when that is empty,
+ * stealing from the top of another worker's deque (the biggest pending
+ * subtrees).  Tasks also form the directory tree, which the main thread
+ * prints in pre-order as soon as each node is done, so the output is
+ * identical to the serial dump.
+ */
+struct pathnode {
+  char *path;
+  int inumber;
+  struct inode inode;
+  char *output;               // this path's line, if any
+  size_t outputLen;
+  struct pathnode **children; // in directory order
+  int numChildren;
+  int maxChildren;
+  int failed;                 // the path or one of its children couldn't be dumped
+  int done;                   // output and children are final
+};
+
+struct taskdeque {
+  pthread_mutex_t lock;
+  struct pathnode **tasks;    // tasks[head..tail) are queued
+  int head;
+  int tail;
+  int capacity;
+};
+
+struct pathwalk {
+  struct unixfilesystem *fs;
+  const struct dump_options *options;
+  struct taskdeque *deques;   // one per worker
+  int numWorkers;
+  int pending;                // tasks queued or being visited
+  int queued;                 // tasks in the deques not yet claimed by a worker
+  pthread_mutex_t idleLock;   // protects pending and queued
+  pthread_cond_t workAvailable;
+  pthread_mutex_t doneLock;   // protects pathnode.done
+  pthread_cond_t nodeDone;
+};
+
+struct pathworker {
+  struct pathwalk *walk;
+  int id;
+};
+
+struct childvisit {
+  struct pathwalk *walk;
+  int worker;
+  struct pathnode *parent;
+};
+
+static struct pathnode *NewPathNode(const char *path, int inumber, const struct inode *in) {
+  struct pathnode *node = calloc(1, sizeof(struct pathnode));
+  if (node == NULL) return NULL;
+  node->path = strdup(path);
+  node->inumber = inumber;
+  node->inode = *in;
+  if (node->path == NULL) {
+    free(node);
+    return NULL;
+  }
+  return node;
+}
+
+/**
+ * Queues node on the worker's deque.  Only once it's there is it counted, so a
+ * worker that claims it by decrementing queued is sure to find a task.
+ */
+static void PushTask(struct pathwalk *walk, int worker, struct pathnode *node) {
+  struct taskdeque *dq = &walk->deques[worker];
+  pthread_mutex_lock(&dq->lock);
+  if (dq->tail == dq->capacity) {
+    memmove(dq->tasks, dq->tasks + dq->head, (dq->tail - dq->head) * sizeof(struct pathnode *));
+    dq->tail -= dq->head;
+    dq->head = 0;
+    if (dq->tail == dq->capacity) {
+      dq->capacity = dq->capacity ? 2 * dq->capacity : 64;
+      dq->tasks = realloc(dq->tasks, dq->capacity * sizeof(struct pathnode *));
+      if (dq->tasks == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  dq->tasks[dq->tail++] = node;
+  pthread_mutex_unlock(&dq->lock);
+
+  pthread_mutex_lock(&walk->idleLock);
+  walk->pending++;
+  walk->queued++;
+  pthread_cond_signal(&walk->workAvailable);
+  pthread_mutex_unlock(&walk->idleLock);
+}
+
+// Takes the newest task of the worker's own deque.
+static struct pathnode *PopTask(struct taskdeque *dq) {
+  struct pathnode *node = NULL;
+  pthread_mutex_lock(&dq->lock);
+  if (dq->head < dq->tail) node = dq->tasks[--dq->tail];
+  pthread_mutex_unlock(&dq->lock);
+  return node;
+}
+
+// Takes the oldest task of some other worker's deque.
+static struct pathnode *StealTask(struct pathwalk *walk, int worker) {
+  for (int i = 1; i < walk->numWorkers; i++) {
+    struct taskdeque *dq = &walk->deques[(worker + i) % walk->numWorkers];
+    pthread_mutex_lock(&dq->lock);
+    struct pathnode *node = (dq->head < dq->tail) ? dq->tasks[dq->head++] : NULL;
+    pthread_mutex_unlock(&dq->lock);
+    if (node != NULL) return node;
+  }
+  return NULL;
+}
+
+static void AddChildTask(const char *childpath, int childinumber, const struct inode *childinode, void *arg) {
+  struct childvisit *visit = arg;
+  struct pathnode *parent = visit->parent;
+  struct pathnode *child = NewPathNode(childpath, childinumber, childinode);
+  if (parent->numChildren == parent->maxChildren) {
+    parent->maxChildren = parent->maxChildren ? 2 * parent->maxChildren : 8;
+    parent->children = realloc(parent->children, parent->maxChildren * sizeof(struct pathnode *));
+  }
+  if (child == NULL || parent->children == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  parent->children[parent->numChildren++] = child;
+  PushTask(visit->walk, visit->worker, child);
+}
+
+static void VisitPathNode(struct pathwalk *walk, int worker, struct pathnode *node) {
+  FILE *out = open_memstream(&node->output, &node->outputLen);
+  if (out == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  int isdir = DumpOnePath(walk->fs, walk->options, node->path, node->inumber, &node->inode, out);
+  fclose(out);
+  int failed = isdir < 0;
+  if (isdir > 0) {
+    struct childvisit visit = { walk, worker, node };
+    failed = ForEachChildPath(walk->fs, node->path, node->inumber, AddChildTask, &visit) < 0;
+  }
+
+  pthread_mutex_lock(&walk->doneLock);
+  node->failed = failed;
+  node->done = 1;
+  pthread_cond_broadcast(&walk->nodeDone);
+  pthread_mutex_unlock(&walk->doneLock);
+}
+
+static void *PathWalkWorker(void *arg) {
+  struct pathworker *self = arg;
+  struct pathwalk *walk = self->walk;
+  while (1) {
+    // Wait until there's a task to claim, or until nobody is visiting a
+    // directory that could queue one.
+    pthread_mutex_lock(&walk->idleLock);
+    while (walk->queued == 0 && walk->pending > 0) {
+      pthread_cond_wait(&walk->workAvailable, &walk->idleLock);
+    }
+    if (walk->queued == 0) {
+      pthread_mutex_unlock(&walk->idleLock);
+      return NULL;
+    }
+    walk->queued--;
+    pthread_mutex_unlock(&walk->idleLock);
+
+    // The claimed task is in some deque, though another worker may be
+    // taking a different one from under us.
+    struct pathnode *node = NULL;
+    while (node == NULL) {
+      node = PopTask(&walk->deques[self->id]);
+      if (node == NULL) node = StealTask(walk, self->id);
+    }
+
+    VisitPathNode(walk, self->id, node);
+
+    pthread_mutex_lock(&walk->idleLock);
+    if (--walk->pending == 0) pthread_cond_broadcast(&walk->workAvailable);
+    pthread_mutex_unlock(&walk->idleLock);
+  }
+}
+
+// Prints the subtree rooted at node in pre-order, waiting for nodes as needed,
+// and frees it.  Returns the number of its nodes that failed.
+static int PrintPathTree(struct pathwalk *walk, struct pathnode *node, FILE *f) {
+  pthread_mutex_lock(&walk->doneLock);
+  while (!node->done) pthread_cond_wait(&walk->nodeDone, &walk->doneLock);
+  pthread_mutex_unlock(&walk->doneLock);
+
+  fwrite(node->output, 1, node->outputLen, f);
+  int errors = node->failed;
+  for (int i = 0; i < node->numChildren; i++) {
+    errors += PrintPathTree(walk, node->children[i], f);
+  }
+  free(node->output);
+  free(node->children);
+  free(node->path);
+  free(node);
+  return errors;
+}
+
+static int DumpPathsParallel(struct unixfilesystem *fs, const struct dump_options *options,
+                             const struct inode *rootinode, FILE *f) {
+  int numThreads = options->numThreads;
+  struct pathwalk walk;
+  walk.fs = fs;
+  walk.options = options;
+  walk.numWorkers = numThreads;
+  walk.pending = 0;
+  walk.queued = 0;
+  walk.deques = calloc(numThreads, sizeof(struct taskdeque));
+  struct pathnode *root = NewPathNode("/", ROOT_INUMBER, rootinode);
+  if (walk.deques == NULL || root == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    free(walk.deques);
+    return -1;
+  }
+  for (int i = 0; i < numThreads; i++) {
+    pthread_mutex_init(&walk.deques[i].lock, NULL);
+  }
+  pthread_mutex_init(&walk.idleLock, NULL);
+  pthread_cond_init(&walk.workAvailable, NULL);
+  pthread_mutex_init(&walk.doneLock, NULL);
+  pthread_cond_init(&walk.nodeDone, NULL);
+  PushTask(&walk, 0, root);
+
+  pthread_t threads[numThreads];
+  struct pathworker workers[numThreads];
+  int numStarted = 0;
+  for (int i = 0; i < numThreads; i++) {
+    workers[i].walk = &walk;
+    workers[i].id = i;
+    if (pthread_create(&threads[numStarted], NULL, PathWalkWorker, &workers[i]) == 0) numStarted++;
+  }
+  if (numStarted == 0) {
+    // Couldn't start any workers, so do the whole walk on this thread.
+    PathWalkWorker(&workers[0]);
+  }
+  int errors = PrintPathTree(&walk, root, f);
+
+  for (int t = 0; t < numStarted; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  for (int i = 0; i < numThreads; i++) {
+    pthread_mutex_destroy(&walk.deques[i].lock);
+    free(walk.deques[i].tasks);
+  }
+  free(walk.deques);
+  pthread_mutex_destroy(&walk.idleLock);
+  pthread_cond_destroy(&walk.workAvailable);
+  pthread_mutex_destroy(&walk.doneLock);
+  pthread_cond_destroy(&walk.nodeDone);
+  return errors > 0 ? -1 : 0;
+}
+
+int dump_paths(struct unixfilesystem *fs, const struct dump_options *options, FILE *f) {
+  struct inode rootinode;
+  if (inode_iget(fs, ROOT_INUMBER, &rootinode) < 0) {
+    fprintf(stderr,"Can't read inode %d \n", ROOT_INUMBER);
+    return -1;
+  }
+  if (options->numThreads > 1) return DumpPathsParallel(fs, options, &rootinode, f);
+  struct serialdump dump = { fs, options, f, 0 };
+  DumpPathAndChildren(&dump, "/", ROOT_INUMBER, &rootinode);
+  return dump.errors > 0 ? -1 : 0;
+}
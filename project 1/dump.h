@@ -0,0 +1,34 @@
+#ifndef _DUMP_H_
+#define _DUMP_H_
+
+#include <stdio.h>
+
+#include "unixfilesystem.h"
+
+/**
+ * The checksum dumps of diskimageaccess -i and -p, which the grading script
+ * reads, so their output format must not change.  Errors are reported on
+ * stderr as they are found and the dump carries on where it can.
+ */
+
+struct dump_options {
+  int numThreads;    // threads to spread the dump over, 1 for a serial dump
+  int treeThreads;   // tree hash with this many threads per file, 0 for the linear checksum
+};
+
+/**
+ * Outputs to f a line with the checksum of every allocated inode, in inumber
+ * order.  The dump ends at the first inode that can't be read.  Returns 0 if
+ * every allocated inode was dumped, -1 otherwise.
+ */
+int dump_inodes(struct unixfilesystem *fs, const struct dump_options *options, FILE *f);
+
+/**
+ * Outputs to f a line with the checksum of every path, walking the naming
+ * hierarchy from the root in pre-order with the entries of each directory in
+ * directory order.  The output is the same whatever the number of threads.
+ * Returns 0 if every path was dumped, -1 otherwise.
+ */
+int dump_paths(struct unixfilesystem *fs, const struct dump_options *options, FILE *f);
+
+#endif // _DUMP_H_
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "file.h"
+#include "inode.h"
+#include "diskimg.h"
+#include "readahead.h"
+#include "dirindex.h"
+#include "dcache.h"
+#include "iostats.h"
+
+/**
+ * Tells the read-ahead tracker that blocks [firstBlock, firstBlock+numBlocks)
+ * of the file are being read and, if it detects a sequential reader, starts
+ * fetching the disk blocks the reader will want next.  The indirect block
+ * that maps the block after the window is prefetched too, so resolving the
+ * next window doesn't stall on it.
+ */
+static void read_ahead(struct unixfilesystem *fs, int inumber, struct inode *inp, int firstBlock, int numBlocks) {
+  if (fs->readahead == NULL) return;
+  int start;
+  int count = readahead_access(fs->readahead, inumber, firstBlock, numBlocks, &start);
+  int fileBlocks = (inode_getsize(inp) + DISKIMG_SECTOR_SIZE - 1) / DISKIMG_SECTOR_SIZE;
+  if (count > fileBlocks - start) count = fileBlocks - start;
+  if (count <= 0) return;
+
+  int blockNums[count];
+  if (inode_blockmap(fs, inp, start, count, blockNums) < 0) return;
+  int runStart = 0;
+  while (runStart < count) {
+    int runLen = 1;
+    while (runStart + runLen < count && blockNums[runStart + runLen] == blockNums[runStart] + runLen) {
+      runLen++;
+    }
+    if (blockNums[runStart] != 0) diskimg_prefetch(fs->dfd, blockNums[runStart], runLen);
+    runStart += runLen;
+  }
+
+  if (start + count < fileBlocks) {
+    int indirBlockNum = inode_indirectblock(fs, inp, start + count);
+    if (indirBlockNum > 0) diskimg_prefetch(fs->dfd, indirBlockNum, 1);
+  }
+}
+
+int file_getblock(struct unixfilesystem *fs, int inumber, int blockNum, void *buf) {
+  const void *block;
+  int validBytes = file_getblockref(fs, inumber, blockNum, buf, &block);
+  if (validBytes > 0 && block != buf) {
+    memcpy(buf, block, DISKIMG_SECTOR_SIZE);
+  }
+  return validBytes;
+}
+
+int file_getblockref(struct unixfilesystem *fs, int inumber, int blockNum, void *buf, const void **blockp) {
+  struct inode i;
+  if (inode_iget(fs, inumber, &i) < 0) {
+    fprintf(stderr, "Error reading inode %d \n", inumber);
+    return -1;
+  }
+
+  int size = inode_getsize(&i);
+  int numBlocks = (size + DISKIMG_SECTOR_SIZE - 1) / DISKIMG_SECTOR_SIZE;
+  int maxBlockNum = numBlocks - 1;
+
+  int actualBlockNum = inode_indexlookup(fs, &i, blockNum);
+  if (actualBlockNum >= 0) read_ahead(fs, inumber, &i, blockNum, 1);
+  *blockp = (actualBlockNum < 0) ? NULL : iostats_sectorref(fs, IOSITE_FILE_GETBLOCK, actualBlockNum, buf);
+  if (*blockp == NULL) {
+    fprintf(stderr, "Error reading block %d\n", blockNum);
+    return -1;
+  }
+
+  int validBytes = (blockNum >= maxBlockNum) ? size - maxBlockNum * DISKIMG_SECTOR_SIZE : DISKIMG_SECTOR_SIZE;
+  return validBytes;
+}
+
+/**
+ * Reads numBlocks file blocks starting at blockNo, which are stored in
+ * consecutive sectors starting at sectorNum, and copies whatever part of them
+ * falls in the file's byte range [offset, offset+len) to the corresponding
+ * place in buf.  Whole blocks are read straight into buf; only a partial
+ * first or last block of the range goes through a scratch buffer.
+ * Returns 0 on success, -1 on error.
+ */
+static int read_run(struct unixfilesystem *fs, int sectorNum, int blockNo, int numBlocks,
+                    int offset, int len, char *buf) {
+  char scratch[2][DISKIMG_SECTOR_SIZE];
+  int scratchStart[2];
+  int numScratch = 0;
+  struct iovec iov[3];
+  int iovcnt = 0;
+
+  for (int i = 0; i < numBlocks; i++) {
+    int blockStart = (blockNo + i) * DISKIMG_SECTOR_SIZE;
+    if (blockStart >= offset && blockStart + DISKIMG_SECTOR_SIZE <= offset + len) {
+      char *dst = buf + (blockStart - offset);
+      if (iovcnt > 0 && (char *) iov[iovcnt - 1].iov_base + iov[iovcnt - 1].iov_len == dst) {
+        iov[iovcnt - 1].iov_len += DISKIMG_SECTOR_SIZE;
+        continue;
+      }
+      iov[iovcnt].iov_base = dst;
+    } else {
+      scratchStart[numScratch] = blockStart;
+      iov[iovcnt].iov_base = scratch[numScratch++];
+    }
+    iov[iovcnt++].iov_len = DISKIMG_SECTOR_SIZE;
+  }
+
+  if (iostats_readv(fs, IOSITE_FILE_READ, sectorNum, iov, iovcnt) != numBlocks * DISKIMG_SECTOR_SIZE) {
+    fprintf(stderr, "Error reading block %d\n", blockNo);
+    return -1;
+  }
+
+  for (int s = 0; s < numScratch; s++) {
+    int start = (scratchStart[s] > offset) ? scratchStart[s] : offset;
+    int end = (scratchStart[s] + DISKIMG_SECTOR_SIZE < offset + len) ? scratchStart[s] + DISKIMG_SECTOR_SIZE : offset + len;
+    memcpy(buf + (start - offset), scratch[s] + (start - scratchStart[s]), end - start);
+  }
+  return 0;
+}
+
+int file_read(struct unixfilesystem *fs, int inumber, int offset, int len, void *buf) {
+  struct inode in;
+  if (inode_iget(fs, inumber, &in) < 0) {
+    fprintf(stderr, "Error reading inode %d \n", inumber);
+    return -1;
+  }
+  if (offset < 0 || len < 0) return -1;
+
+  int size = inode_getsize(&in);
+  if (offset >= size) return 0;
+  if (len > size - offset) len = size - offset;
+  if (len == 0) return 0;
+
+  int firstBlock = offset / DISKIMG_SECTOR_SIZE;
+  int numBlocks = (offset + len - 1) / DISKIMG_SECTOR_SIZE - firstBlock + 1;
+  int *blockNums = malloc(numBlocks * sizeof(int));
+  if (blockNums == NULL) return -1;
+  if (inode_blockmap(fs, &in, firstBlock, numBlocks, blockNums) < 0) {
+    fprintf(stderr, "Error mapping blocks of inode %d\n", inumber);
+    free(blockNums);
+    return -1;
+  }
+  read_ahead(fs, inumber, &in, firstBlock, numBlocks);
+
+  int err = 0;
+  int runStart = 0;
+  while (runStart < numBlocks && err == 0) {
+    int runLen = 1;
+    while (runStart + runLen < numBlocks && blockNums[runStart + runLen] == blockNums[runStart] + runLen) {
+      runLen++;
+    }
+    err = read_run(fs, blockNums[runStart], firstBlock + runStart, runLen, offset, len, buf);
+    runStart += runLen;
+  }
+  free(blockNums);
+  return (err < 0) ? -1 : len;
+}
+
+// Largest size the 24-bit i_size0/i_size1 pair can record.
+#define MAX_FILE_SIZE 0xffffff
+
+int file_write(struct unixfilesystem *fs, int inumber, int offset, int len, const void *buf) {
+  struct inode in;
+  if (inode_iget(fs, inumber, &in) < 0) {
+    fprintf(stderr, "Error reading inode %d \n", inumber);
+    return -1;
+  }
+  if (offset < 0 || len < 0 || offset > MAX_FILE_SIZE - len) return -1;
+  if (len == 0) return 0;
+
+  // Writing past the end of the file fills the gap with zeros, so the file
+  // never has unallocated blocks inside it.
+  int size = inode_getsize(&in);
+  int end = offset + len;
+  int pos = (offset > size) ? size : offset;
+  char block[DISKIMG_SECTOR_SIZE];
+  int err = 0;
+  while (pos < end) {
+    int blockNum = pos / DISKIMG_SECTOR_SIZE;
+    int blockOffset = pos % DISKIMG_SECTOR_SIZE;
+    int n = DISKIMG_SECTOR_SIZE - blockOffset;
+    int limit = (pos < offset) ? offset : end;
+    if (n > limit - pos) n = limit - pos;
+
+    int sectorNum = inode_indexalloc(fs, &in, blockNum);
+    if (sectorNum < 0) {
+      err = -1;
+      break;
+    }
+    if (n < DISKIMG_SECTOR_SIZE && iostats_readsector(fs, IOSITE_FILE_WRITE, sectorNum, block) != DISKIMG_SECTOR_SIZE) {
+      err = -1;
+      break;
+    }
+    if (pos < offset) {
+      memset(block + blockOffset, 0, n);
+    } else {
+      memcpy(block + blockOffset, (const char *) buf + (pos - offset), n);
+    }
+    if (iostats_writesector(fs, IOSITE_FILE_WRITE, sectorNum, block) != DISKIMG_SECTOR_SIZE) {
+      err = -1;
+      break;
+    }
+    pos += n;
+  }
+
+  // Blocks allocated before an error are kept, so the inode is written out
+  // either way.
+  if (pos > size) {
+    in.i_size0 = pos >> 16;
+    in.i_size1 = pos & 0xffff;
+  }
+  uint32_t now = time(NULL);
+  in.i_mtime[0] = now >> 16;
+  in.i_mtime[1] = now & 0xffff;
+  if (inode_iput(fs, inumber, &in) < 0) err = -1;
+
+  if ((in.i_mode & IFMT) == IFDIR) {
+    // Cached names below this directory may no longer be right.
+    if (fs->dirindex != NULL) dirindex_invalidate(fs->dirindex, inumber);
+    if (fs->dcache != NULL) dcache_clear(fs->dcache);
+  }
+
+  if (err < 0) {
+    fprintf(stderr, "Error writing inode %d\n", inumber);
+    return -1;
+  }
+  return len;
+}
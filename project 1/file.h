@@ -9,4 +9,32 @@
  */
 int file_getblock(struct unixfilesystem *fs, int inumber, int blockNo, void *buf); 
 
+/**
+ * Same as file_getblock, but sets *blockp to point at the block's contents
+ * instead of always copying them into buf.  When the disk image is memory
+ * mapped *blockp points into the mapping, otherwise the block is read into
+ * buf (DISKIMG_SECTOR_SIZE bytes) and *blockp is buf.  The block must not be
+ * modified through *blockp.
+ * Returns the number of valid bytes in the block, -1 on error.
+ */
+int file_getblockref(struct unixfilesystem *fs, int inumber, int blockNo, void *buf, const void **blockp);
+
+/**
+ * Reads up to len bytes of the file, starting at byte offset, into buf.  The
+ * disk addresses of all the blocks involved are resolved in one pass, and each
+ * run of physically contiguous blocks is fetched with a single read.
+ * Returns the number of bytes read, which is less than len only at the end of
+ * the file, or -1 on error.
+ */
+int file_read(struct unixfilesystem *fs, int inumber, int offset, int len, void *buf);
+
+/**
+ * Writes len bytes from buf into the file starting at byte offset, allocating
+ * blocks as needed and growing the file if the write ends past its end.  A
+ * gap between the old end of the file and offset reads back as zeros.  Not
+ * thread safe.
+ * Returns len on success, or -1 on error.
+ */
+int file_write(struct unixfilesystem *fs, int inumber, int offset, int len, const void *buf);
+
 #endif // _FILE_H_
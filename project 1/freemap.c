@@ -0,0 +1,124 @@
+#include "freemap.h"
+#include "alloc.h"
+#include "bitmap.h"
+#include "diskimg.h"
+#include "iostats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct freemap {
+  struct bitmap *free;   // bit b set if block b is free
+  int firstDataBlock;
+};
+
+// Marks blockNum free.  Returns -1 if it can't be on the free list.
+static int mark_free(int blockNum, int isLink, void *arg) {
+  struct freemap *map = arg;
+  if (blockNum < map->firstDataBlock || blockNum >= map->free->numBits) {
+    fprintf(stderr, "Bad block %d on free list\n", blockNum);
+    return -1;
+  }
+  if (bitmap_set(map->free, blockNum)) {
+    fprintf(stderr, "Block %d is on the free list twice\n", blockNum);
+    return -1;
+  }
+  return 0;
+}
+
+int freemap_walk(struct unixfilesystem *fs, freemap_visitor visit, void *arg, int *bad) {
+  struct freeblock fb;
+  fb.nfree = fs->superblock.s_nfree;
+  memcpy(fb.free, fs->superblock.s_free, sizeof(fb.free));
+  while (fb.nfree > 0) {
+    if (fb.nfree > NICFREE) {
+      *bad = fb.nfree;
+      return FREEMAP_WALK_BADCOUNT;
+    }
+    for (int i = 1; i < fb.nfree; i++) {
+      if (visit(fb.free[i], 0, arg) < 0) return FREEMAP_WALK_STOPPED;
+    }
+    // free[0] links to the next part of the list, and is itself free.
+    int link = fb.free[0];
+    if (link == 0) break;
+    if (visit(link, 1, arg) < 0) return FREEMAP_WALK_STOPPED;
+    char buf[DISKIMG_SECTOR_SIZE];
+    if (iostats_readsector(fs, IOSITE_FREEMAP_WALK, link, buf) != DISKIMG_SECTOR_SIZE) {
+      *bad = link;
+      return FREEMAP_WALK_BADREAD;
+    }
+    memcpy(&fb, buf, sizeof(fb));
+  }
+  return FREEMAP_WALK_END;
+}
+
+struct freemap *freemap_build(struct unixfilesystem *fs) {
+  struct freemap *map = malloc(sizeof(struct freemap));
+  if (map == NULL) return NULL;
+  map->firstDataBlock = INODE_START_SECTOR + fs->superblock.s_isize;
+  map->free = bitmap_create(fs->superblock.s_fsize);
+  if (map->free == NULL) {
+    free(map);
+    return NULL;
+  }
+
+  int bad;
+  int err = freemap_walk(fs, mark_free, map, &bad);
+  if (err == FREEMAP_WALK_END) return map;
+  if (err == FREEMAP_WALK_BADCOUNT) fprintf(stderr, "Corrupt free list count %d\n", bad);
+  freemap_free(map);
+  return NULL;
+}
+
+void freemap_free(struct freemap *map) {
+  if (map == NULL) return;
+  bitmap_free(map->free);
+  free(map);
+}
+
+int freemap_isfree(struct freemap *map, int blockNum) {
+  if (blockNum < 0 || blockNum >= map->free->numBits) return 0;
+  return bitmap_test(map->free, blockNum);
+}
+
+int freemap_countfree(struct freemap *map, int firstBlock, int numBlocks) {
+  return bitmap_countrange(map->free, firstBlock, firstBlock + numBlocks);
+}
+
+void freemap_getstats(struct freemap *map, struct freemap_stats *stats) {
+  stats->numFree = bitmap_count(map->free);
+  stats->numRuns = 0;
+  stats->longestRun = 0;
+  stats->longestRunStart = -1;
+  int numBlocks = map->free->numBits;
+  int start = bitmap_findset(map->free, map->firstDataBlock);
+  while (start < numBlocks) {
+    int end = bitmap_findclear(map->free, start);
+    stats->numRuns++;
+    if (end - start > stats->longestRun) {
+      stats->longestRun = end - start;
+      stats->longestRunStart = start;
+    }
+    start = bitmap_findset(map->free, end);
+  }
+}
+
+// First run of numBlocks free blocks starting in [from, end), or -1.
+static int find_run(struct freemap *map, int numBlocks, int from, int end) {
+  int start = bitmap_findset(map->free, from);
+  while (start < end) {
+    int runEnd = bitmap_findclear(map->free, start);
+    if (runEnd - start >= numBlocks) return start;
+    start = bitmap_findset(map->free, runEnd);
+  }
+  return -1;
+}
+
+int freemap_findrun(struct freemap *map, int numBlocks, int startBlock) {
+  if (numBlocks <= 0) return -1;
+  int numDiskBlocks = map->free->numBits;
+  if (startBlock < map->firstDataBlock || startBlock >= numDiskBlocks) startBlock = map->firstDataBlock;
+  int run = find_run(map, numBlocks, startBlock, numDiskBlocks);
+  if (run < 0 && startBlock > map->firstDataBlock) run = find_run(map, numBlocks, map->firstDataBlock, startBlock);
+  return run;
+}
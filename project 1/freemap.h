@@ -0,0 +1,79 @@
+#ifndef _FREEMAP_H_
+#define _FREEMAP_H_
+
+#include "unixfilesystem.h"
+
+/**
+ * An in-memory bitmap of the free blocks of a filesystem, built in one walk
+ * of the free list (see alloc.h).  Counting free blocks and searching for
+ * runs of free blocks then work on the bitmap a 64-bit word at a time
+ * instead of following the list.  The map is a snapshot: later allocations
+ * don't update it.  Queries are thread safe.
+ */
+
+struct freemap_stats {
+  int numFree;          // free blocks
+  int numRuns;          // maximal runs of consecutive free blocks
+  int longestRun;       // length of the longest run
+  int longestRunStart;  // its first block, or -1 if there are no free blocks
+};
+
+struct freemap;
+
+/**
+ * Called by freemap_walk with each block on the free list.  isLink is set for
+ * a block that continues the list, which is read next unless visit returns
+ * -1.  Returning -1 for any block ends the walk.
+ */
+typedef int (*freemap_visitor)(int blockNum, int isLink, void *arg);
+
+// How freemap_walk ended.
+#define FREEMAP_WALK_END       0   // at the end of the list
+#define FREEMAP_WALK_STOPPED  -1   // visit returned -1
+#define FREEMAP_WALK_BADCOUNT -2   // a part of the list claims more than NICFREE blocks
+#define FREEMAP_WALK_BADREAD  -3   // a block continuing the list can't be read
+
+/**
+ * Follows the free list of fs from the superblock, calling visit with every
+ * block on it in list order.  The blocks aren't checked: visit must refuse a
+ * link that is out of range or seen before, or a corrupt list can loop.
+ * Returns one of the FREEMAP_WALK codes; for FREEMAP_WALK_BADCOUNT *bad is
+ * set to the count, and for FREEMAP_WALK_BADREAD to the block.
+ */
+int freemap_walk(struct unixfilesystem *fs, freemap_visitor visit, void *arg, int *bad);
+
+/**
+ * Walks the free list of fs and returns a map of it.  Returns NULL if the
+ * list is corrupt (a block out of range or listed twice), on a read error,
+ * or when out of memory.
+ */
+struct freemap *freemap_build(struct unixfilesystem *fs);
+
+/**
+ * Releases the map.
+ */
+void freemap_free(struct freemap *map);
+
+/**
+ * Returns 1 if blockNum is free, 0 otherwise.
+ */
+int freemap_isfree(struct freemap *map, int blockNum);
+
+/**
+ * Returns the number of free blocks among [firstBlock, firstBlock+numBlocks).
+ */
+int freemap_countfree(struct freemap *map, int firstBlock, int numBlocks);
+
+/**
+ * Computes the free block count and the run summary into stats.
+ */
+void freemap_getstats(struct freemap *map, struct freemap_stats *stats);
+
+/**
+ * Finds numBlocks consecutive free blocks, searching from startBlock to the
+ * end of the disk and then from the start of the data area.  Returns the
+ * first block of the run, or -1 if there is no run that long.
+ */
+int freemap_findrun(struct freemap *map, int numBlocks, int startBlock);
+
+#endif // _FREEMAP_H_
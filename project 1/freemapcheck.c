@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "diskimg.h"
+#include "unixfilesystem.h"
+#include "alloc.h"
+#include "freemap.h"
+
+/**
+ * Checks the free map on a scratch image whose free list holds known runs of
+ * blocks, laid down with alloc_freeblock so that it spans several list
+ * blocks: the map must find exactly those blocks free, summarize the runs,
+ * and have freemap_findrun pick the right run, wrapping around to the start
+ * of the data area when nothing after startBlock fits.  Prints one line per
+ * check and exits with status 1 if any failed.
+ */
+
+#define CHECK_BLOCKS   2000
+#define CHECK_IBLOCKS  8
+
+// The free runs, in block order.  Every other block of the last stretch is
+// free, which makes 200 runs of one block.
+#define SHORT_RUN      50    // 10 blocks
+#define SHORT_LEN      10
+#define LONG_RUN       200   // 250 blocks, the longest
+#define LONG_LEN       250
+#define MID_RUN        1000  // 100 blocks
+#define MID_LEN        100
+#define SPARSE_START   1500
+#define SPARSE_END     1900
+
+static char *imagePath;
+static int numFailed = 0;
+
+static void PrintUsageAndExit(char *progname);
+
+static void Report(const char *check, int ok) {
+  printf("%-50s %s\n", check, ok ? "ok" : "FAILED");
+  if (!ok) numFailed++;
+}
+
+static int IsKnownFree(int blockNum) {
+  return (blockNum >= SHORT_RUN && blockNum < SHORT_RUN + SHORT_LEN) ||
+         (blockNum >= LONG_RUN && blockNum < LONG_RUN + LONG_LEN) ||
+         (blockNum >= MID_RUN && blockNum < MID_RUN + MID_LEN) ||
+         (blockNum >= SPARSE_START && blockNum < SPARSE_END && blockNum % 2 == 0);
+}
+
+/**
+ * Creates the scratch image: a boot block, the superblock and a zeroed I
+ * list, then every known free block freed from the top down.  Returns -1 on
+ * error.
+ */
+static int CreateImage(void) {
+  int fd = open(imagePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return -1;
+  if (ftruncate(fd, (off_t) CHECK_BLOCKS * DISKIMG_SECTOR_SIZE) < 0 || close(fd) < 0) return -1;
+
+  fd = diskimg_open(imagePath, 0);
+  if (fd < 0) return -1;
+  char buf[DISKIMG_SECTOR_SIZE];
+  memset(buf, 0, sizeof(buf));
+  uint16_t *bootblock = (uint16_t *) buf;
+  bootblock[0] = BOOTBLOCK_MAGIC_NUM;
+  struct filsys sb;
+  memset(&sb, 0, sizeof(sb));
+  sb.s_isize = CHECK_IBLOCKS;
+  sb.s_fsize = CHECK_BLOCKS;
+  if (diskimg_writesector(fd, BOOTBLOCK_SECTOR, buf) != DISKIMG_SECTOR_SIZE ||
+      diskimg_writesector(fd, SUPERBLOCK_SECTOR, &sb) != DISKIMG_SECTOR_SIZE) {
+    diskimg_close(fd);
+    return -1;
+  }
+
+  struct unixfilesystem *fs = unixfilesystem_init(fd);
+  int err = (fs == NULL) ? -1 : 0;
+  for (int b = CHECK_BLOCKS - 1; err == 0 && b >= INODE_START_SECTOR + CHECK_IBLOCKS; b--) {
+    if (IsKnownFree(b)) err = alloc_freeblock(fs, b);
+  }
+  if (fs != NULL) {
+    if (unixfilesystem_sync(fs) < 0) err = -1;
+    unixfilesystem_free(fs);
+  }
+  if (diskimg_close(fd) < 0) err = -1;
+  return err;
+}
+
+static void CheckMap(struct freemap *map) {
+  int numKnown = 0;
+  int matches = 1;
+  for (int b = 0; b < CHECK_BLOCKS; b++) {
+    if (IsKnownFree(b)) numKnown++;
+    if (freemap_isfree(map, b) != IsKnownFree(b)) matches = 0;
+  }
+  Report("the list spans several list blocks", numKnown > 3 * NICFREE);
+  Report("exactly the freed blocks are free", matches);
+  Report("free blocks are counted by range",
+         freemap_countfree(map, 0, CHECK_BLOCKS) == numKnown &&
+         freemap_countfree(map, LONG_RUN - 5, 10) == 5 &&
+         freemap_countfree(map, SPARSE_START, 10) == 5);
+
+  struct freemap_stats stats;
+  freemap_getstats(map, &stats);
+  Report("the runs are summarized",
+         stats.numFree == numKnown && stats.numRuns == 3 + (SPARSE_END - SPARSE_START) / 2 &&
+         stats.longestRun == LONG_LEN && stats.longestRunStart == LONG_RUN);
+}
+
+static void CheckFindRun(struct freemap *map) {
+  int firstDataBlock = INODE_START_SECTOR + CHECK_IBLOCKS;
+  Report("findrun skips runs that are too short", freemap_findrun(map, SHORT_LEN + 1, firstDataBlock) == LONG_RUN);
+  Report("findrun takes the first run that fits", freemap_findrun(map, SHORT_LEN, firstDataBlock) == SHORT_RUN);
+  Report("findrun starts at startBlock", freemap_findrun(map, MID_LEN, LONG_RUN + LONG_LEN) == MID_RUN);
+  Report("findrun can start inside a run", freemap_findrun(map, 20, LONG_RUN + 100) == LONG_RUN + 100);
+  Report("findrun wraps to the start of the data area", freemap_findrun(map, 2, SPARSE_START) == SHORT_RUN);
+  Report("findrun finds single blocks", freemap_findrun(map, 1, SPARSE_START + 1) == SPARSE_START + 2);
+  Report("findrun fails when no run is long enough", freemap_findrun(map, LONG_LEN + 1, firstDataBlock) == -1);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) PrintUsageAndExit(argv[0]);
+  imagePath = argv[1];
+  if (CreateImage() < 0) {
+    fprintf(stderr, "Can't create %s\n", imagePath);
+    exit(EXIT_FAILURE);
+  }
+
+  int fd = diskimg_open(imagePath, 1);
+  struct unixfilesystem *fs = (fd < 0) ? NULL : unixfilesystem_init(fd);
+  struct freemap *map = (fs == NULL) ? NULL : freemap_build(fs);
+  Report("the free map is built", map != NULL);
+  if (map != NULL) {
+    CheckMap(map);
+    CheckFindRun(map);
+    freemap_free(map);
+  }
+  if (fs != NULL) unixfilesystem_free(fs);
+  if (fd >= 0) diskimg_close(fd);
+
+  unlink(imagePath);
+  exit(numFailed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+  return 0;
+}
+
+static void PrintUsageAndExit(char *progname) {
+  fprintf(stderr, "Usage: %s scratchImagePath\n", progname);
+  fprintf(stderr, "Checks the free map and its run search on a scratch image, which is created\n");
+  fprintf(stderr, "and removed.\n");
+  exit(EXIT_FAILURE);
+}
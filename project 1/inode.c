@@ -0,0 +1,214 @@
+#include "inode.h"
+#include "diskimg.h"
+#include "alloc.h"
+#include "iostats.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INODES_PER_BLOCK    ((int) (DISKIMG_SECTOR_SIZE / sizeof(struct inode)))
+
+int inode_iget(struct unixfilesystem *fs, int inumber, struct inode *inp) {
+  if (inumber < 1) return -1;
+  if (inumber <= fs->ninodes) {
+    *inp = fs->itable[inumber - 1];
+    return 0;
+  }
+
+  int offset = (inumber - 1) / INODES_PER_BLOCK;
+  struct inode buf[INODES_PER_BLOCK];
+  const struct inode *inodes = iostats_sectorref(fs, IOSITE_INODE_IGET, INODE_START_SECTOR + offset, buf);
+  if (inodes == NULL) return -1;
+  *inp = inodes[(inumber - 1) % INODES_PER_BLOCK];
+  return 0;
+}
+
+// One request of a batch: an inumber and where its inode goes.
+struct igetrequest {
+  int inumber;
+  int index;
+};
+
+static int compare_requests(const void *a, const void *b) {
+  return ((const struct igetrequest *) a)->inumber - ((const struct igetrequest *) b)->inumber;
+}
+
+int inode_iget_batch(struct unixfilesystem *fs, const int *inumbers, int n, struct inode *out) {
+  if (n <= 0) return 0;
+  struct igetrequest *requests = malloc(n * sizeof(struct igetrequest));
+  if (requests == NULL) return -1;
+  for (int i = 0; i < n; i++) {
+    requests[i].inumber = inumbers[i];
+    requests[i].index = i;
+  }
+  // Inumber order is I list order, so each sector comes up once.
+  qsort(requests, n, sizeof(struct igetrequest), compare_requests);
+
+  struct inode buf[INODES_PER_BLOCK];
+  const struct inode *inodes = NULL;
+  int currentSector = -1;
+  int err = 0;
+  for (int i = 0; i < n && err == 0; i++) {
+    int inumber = requests[i].inumber;
+    if (inumber < 1) {
+      err = -1;
+    } else if (inumber <= fs->ninodes) {
+      out[requests[i].index] = fs->itable[inumber - 1];
+    } else {
+      int offset = (inumber - 1) / INODES_PER_BLOCK;
+      if (offset != currentSector) {
+        inodes = iostats_sectorref(fs, IOSITE_INODE_IGETBATCH, INODE_START_SECTOR + offset, buf);
+        currentSector = offset;
+        if (inodes == NULL) err = -1;
+      }
+      if (err == 0) out[requests[i].index] = inodes[(inumber - 1) % INODES_PER_BLOCK];
+    }
+  }
+  free(requests);
+  return err;
+}
+
+int inode_iput(struct unixfilesystem *fs, int inumber, const struct inode *inp) {
+  if (inumber < 1 || (inumber - 1) / INODES_PER_BLOCK >= fs->superblock.s_isize) return -1;
+  int sectorNum = INODE_START_SECTOR + (inumber - 1) / INODES_PER_BLOCK;
+  struct inode buf[INODES_PER_BLOCK];
+  if (iostats_readsector(fs, IOSITE_INODE_IPUT, sectorNum, buf) != DISKIMG_SECTOR_SIZE) return -1;
+  buf[(inumber - 1) % INODES_PER_BLOCK] = *inp;
+  if (iostats_writesector(fs, IOSITE_INODE_IPUT, sectorNum, buf) != DISKIMG_SECTOR_SIZE) return -1;
+  if (inumber <= fs->ninodes) {
+    fs->itable[inumber - 1] = *inp;
+  }
+  return 0;
+}
+
+int inode_indexlookup(struct unixfilesystem *fs, struct inode *inp, int blockNum) {
+  if (!(inp->i_mode & ILARG)) {
+    return inp->i_addr[blockNum];
+  }
+
+  uint16_t buf[ADDRS_PER_BLOCK];
+  const uint16_t *indir;
+  if (blockNum < NUM_INDIRECT_ADDRS * ADDRS_PER_BLOCK) {
+    int indirBlockNum = blockNum / ADDRS_PER_BLOCK;
+    indir = iostats_sectorref(fs, IOSITE_INODE_INDEXLOOKUP, inp->i_addr[indirBlockNum], buf);
+  } else {
+    // The last address is doubly indirect.
+    int indirBlockNum = (blockNum - NUM_INDIRECT_ADDRS * ADDRS_PER_BLOCK) / ADDRS_PER_BLOCK;
+    indir = iostats_sectorref(fs, IOSITE_INODE_INDEXLOOKUP, inp->i_addr[NUM_INDIRECT_ADDRS], buf);
+    if (indir == NULL) return -1;
+    indir = iostats_sectorref(fs, IOSITE_INODE_INDEXLOOKUP, indir[indirBlockNum], buf);
+  }
+  if (indir == NULL) return -1;
+  return indir[blockNum % ADDRS_PER_BLOCK];
+}
+
+int inode_blockmap(struct unixfilesystem *fs, struct inode *inp, int firstBlock, int numBlocks, int *blockNums) {
+  if (firstBlock < 0 || numBlocks < 0) return -1;
+  if (!(inp->i_mode & ILARG)) {
+    if (firstBlock + numBlocks > (int) (sizeof(inp->i_addr) / sizeof(inp->i_addr[0]))) return -1;
+    for (int i = 0; i < numBlocks; i++) {
+      blockNums[i] = inp->i_addr[firstBlock + i];
+    }
+    return 0;
+  }
+
+  uint16_t doublyBuf[ADDRS_PER_BLOCK];
+  uint16_t indirBuf[ADDRS_PER_BLOCK];
+  const uint16_t *doubly = NULL;
+  const uint16_t *indir = NULL;
+  int indirIndex = -1;  // which indirect block indir holds; 7 and up are reached through doubly
+  for (int i = 0; i < numBlocks; i++) {
+    int blockNum = firstBlock + i;
+    int index = blockNum / ADDRS_PER_BLOCK;
+    if (index != indirIndex) {
+      int indirBlockNum;
+      if (index < NUM_INDIRECT_ADDRS) {
+        indirBlockNum = inp->i_addr[index];
+      } else {
+        if (index - NUM_INDIRECT_ADDRS >= ADDRS_PER_BLOCK) return -1;
+        if (doubly == NULL) {
+          doubly = iostats_sectorref(fs, IOSITE_INODE_BLOCKMAP, inp->i_addr[NUM_INDIRECT_ADDRS], doublyBuf);
+          if (doubly == NULL) return -1;
+        }
+        indirBlockNum = doubly[index - NUM_INDIRECT_ADDRS];
+      }
+      indir = iostats_sectorref(fs, IOSITE_INODE_BLOCKMAP, indirBlockNum, indirBuf);
+      if (indir == NULL) return -1;
+      indirIndex = index;
+    }
+    blockNums[i] = indir[blockNum % ADDRS_PER_BLOCK];
+  }
+  return 0;
+}
+
+// Returns the block number stored at index in address block blockNum,
+// allocating a block for an empty entry and writing the address block back.
+static int get_or_alloc(struct unixfilesystem *fs, int blockNum, int index) {
+  uint16_t addrs[ADDRS_PER_BLOCK];
+  if (iostats_readsector(fs, IOSITE_INODE_INDEXALLOC, blockNum, addrs) != DISKIMG_SECTOR_SIZE) return -1;
+  if (addrs[index] == 0) {
+    int newBlockNum = alloc_block(fs);
+    if (newBlockNum < 0) return -1;
+    addrs[index] = newBlockNum;
+    if (iostats_writesector(fs, IOSITE_INODE_INDEXALLOC, blockNum, addrs) != DISKIMG_SECTOR_SIZE) return -1;
+  }
+  return addrs[index];
+}
+
+int inode_indexalloc(struct unixfilesystem *fs, struct inode *inp, int blockNum) {
+  int numAddrs = sizeof(inp->i_addr) / sizeof(inp->i_addr[0]);
+  if (blockNum < 0 || blockNum >= (NUM_INDIRECT_ADDRS + ADDRS_PER_BLOCK) * ADDRS_PER_BLOCK) return -1;
+  if (!(inp->i_mode & ILARG)) {
+    if (blockNum < numAddrs) {
+      if (inp->i_addr[blockNum] == 0) {
+        int newBlockNum = alloc_block(fs);
+        if (newBlockNum < 0) return -1;
+        inp->i_addr[blockNum] = newBlockNum;
+      }
+      return inp->i_addr[blockNum];
+    }
+
+    // Convert to a large file: the direct addresses move into the first
+    // indirect block, which maps the same file blocks.
+    int indirBlockNum = alloc_block(fs);
+    if (indirBlockNum < 0) return -1;
+    uint16_t addrs[ADDRS_PER_BLOCK];
+    memset(addrs, 0, sizeof(addrs));
+    memcpy(addrs, inp->i_addr, sizeof(inp->i_addr));
+    if (iostats_writesector(fs, IOSITE_INODE_INDEXALLOC, indirBlockNum, addrs) != DISKIMG_SECTOR_SIZE) return -1;
+    memset(inp->i_addr, 0, sizeof(inp->i_addr));
+    inp->i_addr[0] = indirBlockNum;
+    inp->i_mode |= ILARG;
+  }
+
+  int index = blockNum / ADDRS_PER_BLOCK;
+  int slot = (index < NUM_INDIRECT_ADDRS) ? index : NUM_INDIRECT_ADDRS;
+  if (inp->i_addr[slot] == 0) {
+    int newBlockNum = alloc_block(fs);
+    if (newBlockNum < 0) return -1;
+    inp->i_addr[slot] = newBlockNum;
+  }
+  int indirBlockNum = inp->i_addr[slot];
+  if (index >= NUM_INDIRECT_ADDRS) {
+    // The last address is doubly indirect.
+    indirBlockNum = get_or_alloc(fs, indirBlockNum, index - NUM_INDIRECT_ADDRS);
+    if (indirBlockNum < 0) return -1;
+  }
+  return get_or_alloc(fs, indirBlockNum, blockNum % ADDRS_PER_BLOCK);
+}
+
+int inode_indirectblock(struct unixfilesystem *fs, struct inode *inp, int blockNum) {
+  if (!(inp->i_mode & ILARG)) return 0;
+  int index = blockNum / ADDRS_PER_BLOCK;
+  if (index < NUM_INDIRECT_ADDRS) return inp->i_addr[index];
+  if (index - NUM_INDIRECT_ADDRS >= ADDRS_PER_BLOCK) return -1;
+
+  uint16_t buf[ADDRS_PER_BLOCK];
+  const uint16_t *doubly = iostats_sectorref(fs, IOSITE_INODE_INDIRECTBLOCK, inp->i_addr[NUM_INDIRECT_ADDRS], buf);
+  if (doubly == NULL) return -1;
+  return doubly[index - NUM_INDIRECT_ADDRS];
+}
+
+int inode_getsize(const struct inode *inp) {
+  return ((inp->i_size0 << 16) | inp->i_size1);
+}
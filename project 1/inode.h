@@ -2,6 +2,11 @@
 #define _INODE_H
 
 #include "unixfilesystem.h"
+#include "diskimg.h"
+
+// Block numbers held by an indirect block.
+#define ADDRS_PER_BLOCK     ((int) (DISKIMG_SECTOR_SIZE / sizeof(uint16_t)))
+#define NUM_INDIRECT_ADDRS  7  // i_addr[0..6] are singly indirect in a large file
 
 /**
  * Fetches the specified inode from the filesystem. 
@@ -9,6 +14,20 @@
  */
 int inode_iget(struct unixfilesystem *fs, int inumber, struct inode *inp); 
 
+/**
+ * Fetches the n inodes numbered inumbers[0..n) into out[0..n).  The requests
+ * are served in I list order whatever their order in inumbers, so each sector
+ * of the I list involved is read only once.
+ * Returns 0 on success, -1 if any inode can't be fetched.
+ */
+int inode_iget_batch(struct unixfilesystem *fs, const int *inumbers, int n, struct inode *out);
+
+/**
+ * Writes inode inumber back to the disk (and the in-memory inode table, if
+ * there is one).  Returns 0 on success, -1 on error.
+ */
+int inode_iput(struct unixfilesystem *fs, int inumber, const struct inode *inp);
+
 /**
  * Given an index of a file block, retrieves the file's actual block number
  * of from the given inode.
@@ -17,9 +36,35 @@ int inode_iget(struct unixfilesystem *fs, int inumber, struct inode *inp);
  */
 int inode_indexlookup(struct unixfilesystem *fs, struct inode *inp, int blockNum);
 
+/**
+ * Looks up the disk block numbers of numBlocks consecutive file blocks, starting
+ * with firstBlock, and stores them in blockNums.  Each indirect block involved
+ * is read only once.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int inode_blockmap(struct unixfilesystem *fs, struct inode *inp, int firstBlock, int numBlocks, int *blockNums);
+
+/**
+ * Same as inode_indexlookup, but allocates the block, and any indirect blocks
+ * needed to reach it, if the file doesn't have one yet.  A small file that
+ * needs a block past i_addr is converted to a large (ILARG) file.  Only *inp
+ * is changed; the caller must write it back with inode_iput.
+ *
+ * Returns the disk block number on success, -1 on error.
+ */
+int inode_indexalloc(struct unixfilesystem *fs, struct inode *inp, int blockNum);
+
+/**
+ * Returns the disk block number of the singly indirect block that holds the
+ * address of file block blockNum, 0 if the file is small and has no indirect
+ * blocks, or -1 on error.
+ */
+int inode_indirectblock(struct unixfilesystem *fs, struct inode *inp, int blockNum);
+
 /**
  * Computes the size in bytes of the file identified by the given inode
  */
-int inode_getsize(struct inode *inp);
+int inode_getsize(const struct inode *inp);
 
 #endif // _INODE_
@@ -0,0 +1,232 @@
+#include "iostats.h"
+#include "diskimg.h"
+#include "unixfilesystem.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+
+// Trace records collected before they are written out together.
+#define TRACE_BUFFER_RECORDS 1024
+
+struct iostats {
+  int dfd;
+  struct iostats_counts total;
+  struct iostats_counts sites[IOSITE_NUMSITES];
+  pthread_mutex_t traceLock;   // protects the trace fields
+  int traceFd;                 // -1 when not tracing
+  uint64_t traceStart;
+  struct iostats_record *traceBuf;
+  int traceLen;
+};
+
+static const char *siteNames[IOSITE_NUMSITES] = {
+  [IOSITE_OTHER] = "other",
+  [IOSITE_FS_INIT] = "unixfilesystem_init",
+  [IOSITE_FS_ITABLE] = "load_itable",
+  [IOSITE_FS_SYNC] = "unixfilesystem_sync",
+  [IOSITE_INODE_IGET] = "inode_iget",
+  [IOSITE_INODE_IGETBATCH] = "inode_iget_batch",
+  [IOSITE_INODE_IPUT] = "inode_iput",
+  [IOSITE_INODE_INDEXLOOKUP] = "inode_indexlookup",
+  [IOSITE_INODE_BLOCKMAP] = "inode_blockmap",
+  [IOSITE_INODE_INDEXALLOC] = "inode_indexalloc",
+  [IOSITE_INODE_INDIRECTBLOCK] = "inode_indirectblock",
+  [IOSITE_FILE_GETBLOCK] = "file_getblock",
+  [IOSITE_FILE_READ] = "file_read",
+  [IOSITE_FILE_WRITE] = "file_write",
+  [IOSITE_ALLOC_BLOCK] = "alloc_block",
+  [IOSITE_ALLOC_FREEBLOCK] = "alloc_freeblock",
+  [IOSITE_ALLOC_INODE] = "alloc_inode",
+  [IOSITE_FREEMAP_WALK] = "freemap_walk",
+};
+
+// Call site of the access the calling thread is making.
+static __thread int currentSite = IOSITE_OTHER;
+
+static uint64_t now_nsec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Writes out the buffered trace records.  Called with traceLock held.
+static int flush_trace(struct iostats *stats) {
+  size_t len = stats->traceLen * sizeof(struct iostats_record);
+  size_t done = 0;
+  stats->traceLen = 0;
+  while (done < len) {
+    ssize_t n = write(stats->traceFd, (char *) stats->traceBuf + done, len - done);
+    if (n <= 0) return -1;
+    done += n;
+  }
+  return 0;
+}
+
+static void count(struct iostats_counts *c, int op, int numSectors, int source) {
+  uint64_t bytes = (uint64_t) numSectors * DISKIMG_SECTOR_SIZE;
+  if (op == DISKIMG_OP_WRITE) {
+    __atomic_fetch_add(&c->writes, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->bytesWritten, bytes, __ATOMIC_RELAXED);
+    return;
+  }
+  __atomic_fetch_add(&c->reads, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&c->bytesRead, bytes, __ATOMIC_RELAXED);
+  if (source == DISKIMG_FROM_CACHE) __atomic_fetch_add(&c->cacheHits, numSectors, __ATOMIC_RELAXED);
+  if (source == DISKIMG_FROM_MAP) __atomic_fetch_add(&c->mapHits, numSectors, __ATOMIC_RELAXED);
+}
+
+// The diskimg observer: counts the access and traces it.
+static void observe(void *arg, int op, int sectorNum, int numSectors, int source) {
+  struct iostats *stats = arg;
+  int site = currentSite;
+  count(&stats->total, op, numSectors, source);
+  count(&stats->sites[site], op, numSectors, source);
+
+  if (__atomic_load_n(&stats->traceFd, __ATOMIC_ACQUIRE) < 0) return;
+  pthread_mutex_lock(&stats->traceLock);
+  if (stats->traceFd >= 0) {
+    struct iostats_record *r = &stats->traceBuf[stats->traceLen++];
+    r->nsec = now_nsec() - stats->traceStart;
+    r->sectorNum = sectorNum;
+    r->numSectors = numSectors;
+    r->site = site;
+    r->op = op;
+    r->source = source;
+    r->pad = 0;
+    if (stats->traceLen == TRACE_BUFFER_RECORDS && flush_trace(stats) < 0) {
+      fprintf(stderr, "Error writing I/O trace\n");
+      close(stats->traceFd);
+      stats->traceFd = -1;
+    }
+  }
+  pthread_mutex_unlock(&stats->traceLock);
+}
+
+struct iostats *iostats_create(int dfd) {
+  struct iostats *stats = calloc(1, sizeof(struct iostats));
+  if (stats == NULL) return NULL;
+  stats->dfd = dfd;
+  stats->traceFd = -1;
+  pthread_mutex_init(&stats->traceLock, NULL);
+  diskimg_setobserver(dfd, observe, stats);
+  return stats;
+}
+
+void iostats_free(struct iostats *stats) {
+  if (stats == NULL) return;
+  diskimg_setobserver(stats->dfd, NULL, NULL);
+  if (stats->traceFd >= 0) {
+    if (flush_trace(stats) < 0) fprintf(stderr, "Error writing I/O trace\n");
+    close(stats->traceFd);
+  }
+  free(stats->traceBuf);
+  pthread_mutex_destroy(&stats->traceLock);
+  free(stats);
+}
+
+int iostats_starttrace(struct iostats *stats, const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return -1;
+  struct iostats_traceheader hdr = { IOSTATS_TRACE_MAGIC, sizeof(struct iostats_record) };
+  struct iostats_record *buf = malloc(TRACE_BUFFER_RECORDS * sizeof(struct iostats_record));
+  if (buf == NULL || write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+    free(buf);
+    close(fd);
+    return -1;
+  }
+
+  pthread_mutex_lock(&stats->traceLock);
+  if (stats->traceFd >= 0) {
+    flush_trace(stats);
+    close(stats->traceFd);
+  }
+  free(stats->traceBuf);
+  stats->traceBuf = buf;
+  stats->traceLen = 0;
+  stats->traceStart = now_nsec();
+  __atomic_store_n(&stats->traceFd, fd, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&stats->traceLock);
+  return 0;
+}
+
+static void load_counts(const struct iostats_counts *from, struct iostats_counts *to) {
+  to->reads = __atomic_load_n(&from->reads, __ATOMIC_RELAXED);
+  to->writes = __atomic_load_n(&from->writes, __ATOMIC_RELAXED);
+  to->bytesRead = __atomic_load_n(&from->bytesRead, __ATOMIC_RELAXED);
+  to->bytesWritten = __atomic_load_n(&from->bytesWritten, __ATOMIC_RELAXED);
+  to->cacheHits = __atomic_load_n(&from->cacheHits, __ATOMIC_RELAXED);
+  to->mapHits = __atomic_load_n(&from->mapHits, __ATOMIC_RELAXED);
+}
+
+void iostats_get(struct iostats *stats, struct iostats_counts *total, struct iostats_counts *sites) {
+  load_counts(&stats->total, total);
+  if (sites == NULL) return;
+  for (int s = 0; s < IOSITE_NUMSITES; s++) {
+    load_counts(&stats->sites[s], &sites[s]);
+  }
+}
+
+const char *iostats_sitename(int site) {
+  return (site >= 0 && site < IOSITE_NUMSITES) ? siteNames[site] : "unknown";
+}
+
+static void print_counts(FILE *f, const char *name, const struct iostats_counts *c) {
+  fprintf(f, "%-22s %10llu %10llu %12llu %13llu %10llu %10llu\n", name,
+          (unsigned long long) c->reads, (unsigned long long) c->writes,
+          (unsigned long long) c->bytesRead, (unsigned long long) c->bytesWritten,
+          (unsigned long long) c->cacheHits, (unsigned long long) c->mapHits);
+}
+
+void iostats_print(struct iostats *stats, FILE *f) {
+  struct iostats_counts total;
+  struct iostats_counts sites[IOSITE_NUMSITES];
+  iostats_get(stats, &total, sites);
+  fprintf(f, "%-22s %10s %10s %12s %13s %10s %10s\n", "I/O by call site", "reads", "writes",
+          "bytes read", "bytes written", "cache hits", "map hits");
+  for (int s = 0; s < IOSITE_NUMSITES; s++) {
+    if (sites[s].reads + sites[s].writes > 0) print_counts(f, siteNames[s], &sites[s]);
+  }
+  print_counts(f, "total", &total);
+}
+
+int iostats_readsector(struct unixfilesystem *fs, int site, int sectorNum, void *buf) {
+  int prevSite = currentSite;
+  currentSite = site;
+  int err = diskimg_readsector(fs->dfd, sectorNum, buf);
+  currentSite = prevSite;
+  return err;
+}
+
+int iostats_readsectors(struct unixfilesystem *fs, int site, int sectorNum, int numSectors, void *buf) {
+  int prevSite = currentSite;
+  currentSite = site;
+  int err = diskimg_readsectors(fs->dfd, sectorNum, numSectors, buf);
+  currentSite = prevSite;
+  return err;
+}
+
+int iostats_readv(struct unixfilesystem *fs, int site, int sectorNum, const struct iovec *iov, int iovcnt) {
+  int prevSite = currentSite;
+  currentSite = site;
+  int err = diskimg_readv(fs->dfd, sectorNum, iov, iovcnt);
+  currentSite = prevSite;
+  return err;
+}
+
+int iostats_writesector(struct unixfilesystem *fs, int site, int sectorNum, void *buf) {
+  int prevSite = currentSite;
+  currentSite = site;
+  int err = diskimg_writesector(fs->dfd, sectorNum, buf);
+  currentSite = prevSite;
+  return err;
+}
+
+const void *iostats_sectorref(struct unixfilesystem *fs, int site, int sectorNum, void *buf) {
+  int prevSite = currentSite;
+  currentSite = site;
+  const void *p = diskimg_sectorref(fs->dfd, sectorNum, buf);
+  currentSite = prevSite;
+  return p;
+}
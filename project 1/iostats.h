@@ -0,0 +1,118 @@
+#ifndef _IOSTATS_H_
+#define _IOSTATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/**
+ * Per-filesystem I/O accounting.  The filesystem modules do their sector I/O
+ * through the iostats_* wrappers below, which tag every access with the
+ * library function that made it (its call site).  The diskimg layer reports
+ * each access back, saying whether it was served by the disk, the sector
+ * cache or the mapping, and the access is counted both in the totals and
+ * under its call site.  Accesses made with plain diskimg_* calls on the
+ * filesystem's image count under IOSITE_OTHER.
+ *
+ * Optionally every access is also appended to a binary trace file: an
+ * iostats_traceheader followed by one iostats_record per access, in the
+ * order the accesses completed.
+ *
+ * All operations are thread safe.
+ */
+
+enum iostats_site {
+  IOSITE_OTHER,
+  IOSITE_FS_INIT,
+  IOSITE_FS_ITABLE,
+  IOSITE_FS_SYNC,
+  IOSITE_INODE_IGET,
+  IOSITE_INODE_IGETBATCH,
+  IOSITE_INODE_IPUT,
+  IOSITE_INODE_INDEXLOOKUP,
+  IOSITE_INODE_BLOCKMAP,
+  IOSITE_INODE_INDEXALLOC,
+  IOSITE_INODE_INDIRECTBLOCK,
+  IOSITE_FILE_GETBLOCK,
+  IOSITE_FILE_READ,
+  IOSITE_FILE_WRITE,
+  IOSITE_ALLOC_BLOCK,
+  IOSITE_ALLOC_FREEBLOCK,
+  IOSITE_ALLOC_INODE,
+  IOSITE_FREEMAP_WALK,
+  IOSITE_NUMSITES
+};
+
+struct iostats_counts {
+  uint64_t reads;          // read accesses
+  uint64_t writes;         // write accesses
+  uint64_t bytesRead;
+  uint64_t bytesWritten;
+  uint64_t cacheHits;      // sectors read from the sector cache
+  uint64_t mapHits;        // sectors read from the memory mapping
+};
+
+#define IOSTATS_TRACE_MAGIC 0x56365452  // "V6TR"
+
+struct iostats_traceheader {
+  uint32_t magic;
+  uint32_t recordSize;     // sizeof(struct iostats_record)
+};
+
+struct iostats_record {
+  uint64_t nsec;           // CLOCK_MONOTONIC nanoseconds since the trace started
+  uint32_t sectorNum;      // first sector accessed
+  uint32_t numSectors;
+  uint16_t site;           // enum iostats_site
+  uint8_t op;              // DISKIMG_OP_READ or DISKIMG_OP_WRITE
+  uint8_t source;          // DISKIMG_FROM_*
+  uint32_t pad;
+};
+
+struct unixfilesystem;
+struct iostats;
+
+/**
+ * Allocates zeroed counters for the image open on dfd and starts receiving
+ * its accesses.  Returns NULL when out of memory.
+ */
+struct iostats *iostats_create(int dfd);
+
+/**
+ * Stops receiving accesses, finishes the trace if one is being written, and
+ * releases the counters.
+ */
+void iostats_free(struct iostats *stats);
+
+/**
+ * Starts appending every access to a new trace file at path.  Returns 0 on
+ * success, -1 on error.
+ */
+int iostats_starttrace(struct iostats *stats, const char *path);
+
+/**
+ * Copies the totals into total and, if sites isn't NULL, the breakdown into
+ * sites, which must have room for IOSITE_NUMSITES entries.
+ */
+void iostats_get(struct iostats *stats, struct iostats_counts *total, struct iostats_counts *sites);
+
+/**
+ * Returns the name of a call site, e.g. "inode_iget".
+ */
+const char *iostats_sitename(int site);
+
+/**
+ * Prints the totals and every call site that did any I/O to f.
+ */
+void iostats_print(struct iostats *stats, FILE *f);
+
+/**
+ * The diskimg_* calls of the same names, with the access counted under site.
+ */
+int iostats_readsector(struct unixfilesystem *fs, int site, int sectorNum, void *buf);
+int iostats_readsectors(struct unixfilesystem *fs, int site, int sectorNum, int numSectors, void *buf);
+int iostats_readv(struct unixfilesystem *fs, int site, int sectorNum, const struct iovec *iov, int iovcnt);
+int iostats_writesector(struct unixfilesystem *fs, int site, int sectorNum, void *buf);
+const void *iostats_sectorref(struct unixfilesystem *fs, int site, int sectorNum, void *buf);
+
+#endif // _IOSTATS_H_
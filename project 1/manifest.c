@@ -0,0 +1,151 @@
+#include "manifest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define MANIFEST_MAGIC   0x4d46364d  // "M6FM"
+#define MANIFEST_VERSION 1
+
+struct manifestheader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numInodes;
+  uint32_t pad;
+};
+
+// What a checksum was computed from.  file_write updates i_mtime, so a change
+// goes unnoticed only if a file is rewritten in place, at the same size,
+// within the same second as the checksum was taken.
+struct manifestentry {
+  uint16_t valid;
+  uint16_t mode;
+  uint16_t mtime[2];
+  uint32_t size;
+  uint16_t addr[8];
+  uint8_t  chksum[MANIFEST_CHKSUM_SIZE];
+};
+
+struct manifest {
+  char *path;
+  int numInodes;
+  struct manifestentry *entries;   // indexed by inumber - 1
+  int dirty;                       // changed since loaded
+  struct manifest_stats stats;
+  pthread_mutex_t lock;            // held by every public operation
+};
+
+static int entry_matches(const struct manifestentry *e, const struct inode *in) {
+  return e->valid && e->mode == in->i_mode &&
+         e->mtime[0] == in->i_mtime[0] && e->mtime[1] == in->i_mtime[1] &&
+         e->size == (uint32_t) ((in->i_size0 << 16) | in->i_size1) &&
+         memcmp(e->addr, in->i_addr, sizeof(e->addr)) == 0;
+}
+
+// Fills m->entries from the file at m->path if it holds a manifest of the
+// right size; otherwise leaves them empty.
+static void load_entries(struct manifest *m) {
+  FILE *f = fopen(m->path, "rb");
+  if (f == NULL) return;
+  struct manifestheader hdr;
+  if (fread(&hdr, sizeof(hdr), 1, f) == 1 && hdr.magic == MANIFEST_MAGIC &&
+      hdr.version == MANIFEST_VERSION && hdr.numInodes == (uint32_t) m->numInodes &&
+      fread(m->entries, sizeof(struct manifestentry), m->numInodes, f) == (size_t) m->numInodes) {
+    fclose(f);
+    return;
+  }
+  fclose(f);
+  memset(m->entries, 0, (size_t) m->numInodes * sizeof(struct manifestentry));
+  m->dirty = 1;
+}
+
+struct manifest *manifest_open(const char *path, int numInodes) {
+  if (numInodes < 0) return NULL;
+  struct manifest *m = calloc(1, sizeof(struct manifest));
+  if (m == NULL) return NULL;
+  m->path = strdup(path);
+  m->numInodes = numInodes;
+  m->entries = calloc(numInodes > 0 ? numInodes : 1, sizeof(struct manifestentry));
+  if (m->path == NULL || m->entries == NULL) {
+    free(m->path);
+    free(m->entries);
+    free(m);
+    return NULL;
+  }
+  load_entries(m);
+  pthread_mutex_init(&m->lock, NULL);
+  return m;
+}
+
+void manifest_free(struct manifest *m) {
+  if (m == NULL) return;
+  pthread_mutex_destroy(&m->lock);
+  free(m->path);
+  free(m->entries);
+  free(m);
+}
+
+int manifest_lookup(struct manifest *m, int inumber, const struct inode *in, void *chksum) {
+  int found = 0;
+  pthread_mutex_lock(&m->lock);
+  if (inumber >= 1 && inumber <= m->numInodes && entry_matches(&m->entries[inumber - 1], in)) {
+    memcpy(chksum, m->entries[inumber - 1].chksum, MANIFEST_CHKSUM_SIZE);
+    found = 1;
+    m->stats.hits++;
+  } else {
+    m->stats.misses++;
+  }
+  pthread_mutex_unlock(&m->lock);
+  return found;
+}
+
+void manifest_update(struct manifest *m, int inumber, const struct inode *in, const void *chksum) {
+  if (inumber < 1 || inumber > m->numInodes) return;
+  pthread_mutex_lock(&m->lock);
+  struct manifestentry *e = &m->entries[inumber - 1];
+  e->valid = 1;
+  e->mode = in->i_mode;
+  e->mtime[0] = in->i_mtime[0];
+  e->mtime[1] = in->i_mtime[1];
+  e->size = (in->i_size0 << 16) | in->i_size1;
+  memcpy(e->addr, in->i_addr, sizeof(e->addr));
+  memcpy(e->chksum, chksum, MANIFEST_CHKSUM_SIZE);
+  m->dirty = 1;
+  pthread_mutex_unlock(&m->lock);
+}
+
+int manifest_save(struct manifest *m) {
+  pthread_mutex_lock(&m->lock);
+  int err = 0;
+  if (m->dirty) {
+    // Write a new file, sync it, and only then rename it over the old one,
+    // so a crash never leaves a half written manifest behind.
+    char tmppath[strlen(m->path) + 5];
+    sprintf(tmppath, "%s.tmp", m->path);
+    struct manifestheader hdr = { MANIFEST_MAGIC, MANIFEST_VERSION, m->numInodes, 0 };
+    FILE *f = fopen(tmppath, "wb");
+    if (f == NULL) {
+      err = -1;
+    } else {
+      if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+          fwrite(m->entries, sizeof(struct manifestentry), m->numInodes, f) != (size_t) m->numInodes) {
+        err = -1;
+      }
+      if (err == 0 && (fflush(f) != 0 || fsync(fileno(f)) < 0)) err = -1;
+      if (fclose(f) != 0) err = -1;
+      if (err == 0 && rename(tmppath, m->path) < 0) err = -1;
+      if (err < 0) remove(tmppath);
+    }
+    if (err == 0) m->dirty = 0;
+  }
+  pthread_mutex_unlock(&m->lock);
+  return err;
+}
+
+void manifest_getstats(struct manifest *m, struct manifest_stats *stats) {
+  pthread_mutex_lock(&m->lock);
+  *stats = m->stats;
+  pthread_mutex_unlock(&m->lock);
+}
@@ -0,0 +1,58 @@
+#ifndef _MANIFEST_H_
+#define _MANIFEST_H_
+
+#include "ino.h"
+
+/**
+ * A persistent record of file checksums, kept in a sidecar file next to a disk
+ * image.  The entry for an inumber remembers the inode's mode, size, i_mtime
+ * and block addresses along with the checksum of its contents; as long as
+ * none of those have changed the checksum is reused instead of recomputed.
+ * All operations are thread safe.
+ */
+
+#define MANIFEST_CHKSUM_SIZE 20
+
+struct manifest;
+
+struct manifest_stats {
+  unsigned long long hits;    // checksums reused
+  unsigned long long misses;  // checksums that had to be computed
+};
+
+/**
+ * Loads the manifest stored at path for a filesystem with numInodes inodes.
+ * A missing or unreadable file, or one for a different number of inodes,
+ * gives an empty manifest.  Returns NULL when out of memory.
+ */
+struct manifest *manifest_open(const char *path, int numInodes);
+
+/**
+ * Releases the manifest without saving it.
+ */
+void manifest_free(struct manifest *m);
+
+/**
+ * Copies the recorded checksum of inumber into chksum if the entry matches
+ * the current inode in.  Returns 1 if it did, 0 if the checksum must be
+ * computed.
+ */
+int manifest_lookup(struct manifest *m, int inumber, const struct inode *in, void *chksum);
+
+/**
+ * Records chksum as the checksum of inumber, whose inode is in.
+ */
+void manifest_update(struct manifest *m, int inumber, const struct inode *in, const void *chksum);
+
+/**
+ * Writes the manifest back to its file if anything changed, replacing the
+ * file atomically.  Returns 0 on success, or -1 on error.
+ */
+int manifest_save(struct manifest *m);
+
+/**
+ * Copies the hit/miss counters into stats.
+ */
+void manifest_getstats(struct manifest *m, struct manifest_stats *stats);
+
+#endif // _MANIFEST_H_
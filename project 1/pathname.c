@@ -3,12 +3,17 @@
 #include "directory.h"
 #include "inode.h"
 #include "diskimg.h"
+#include "dcache.h"
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
 #define PATH_SEP "/"
 
+static int cached_lookup(struct unixfilesystem *fs, const char *pathname);
+static int helper(struct unixfilesystem *fs, const int dirinumber,
+                  char *tok, char **saveptr, struct direntv6 *dirEnt);
+
 /**
  * Returns the inode number associated with the specified pathname.  This need only
  * handle absolute paths.  Returns a negative number (-1 is fine) if an error is 
@@ -17,20 +22,76 @@
 int pathname_lookup(struct unixfilesystem *fs, const char *pathname) {
 	if (strcmp(pathname, PATH_SEP) == 0){
     return ROOT_INUMBER;
+  }
+	if (fs->dcache != NULL) {
+    return cached_lookup(fs, pathname);
   }
 	struct direntv6 dirEnt;
 	char pathname_cpy[strlen(pathname)+1];
   strcpy(pathname_cpy, pathname);
-  char *tok = strtok(pathname_cpy + 1, PATH_SEP);
-  return helper(fs, ROOT_INUMBER, tok, &dirEnt);
+  // strtok_r, since lookups may run on several threads at once.
+  char *saveptr;
+  char *tok = strtok_r(pathname_cpy + 1, PATH_SEP, &saveptr);
+  return helper(fs, ROOT_INUMBER, tok, &saveptr, &dirEnt);
 }
 
 // Here we add a helper function since it will be called recursively.
-int helper(struct unixfilesystem *fs, const int dirinumber,
-                           char *tok, struct direntv6 *dirEnt) {
+static int helper(struct unixfilesystem *fs, const int dirinumber,
+                  char *tok, char **saveptr, struct direntv6 *dirEnt) {
 	if (directory_findname(fs, tok, dirinumber, dirEnt) < 0) {
     	return -1;
   }
-  tok = strtok(NULL, PATH_SEP);
-  return (tok == NULL)? dirEnt->d_inumber: helper(fs, dirEnt->d_inumber, tok, dirEnt);
+  tok = strtok_r(NULL, PATH_SEP, saveptr);
+  return (tok == NULL)? dirEnt->d_inumber: helper(fs, dirEnt->d_inumber, tok, saveptr, dirEnt);
+}
+
+/**
+ * Resolves pathname starting from its longest prefix in the dentry cache, and
+ * caches every prefix resolved on the way down.  A component that doesn't
+ * exist is cached as a negative entry, so looking it up again fails at once.
+ */
+static int cached_lookup(struct unixfilesystem *fs, const char *pathname) {
+  // Build the canonical form of the path (no repeated or trailing '/') and
+  // note where each component ends.
+  size_t pathlen = strlen(pathname);
+  char path[pathlen + 2];
+  size_t ends[pathlen + 1];
+  int numComponents = 0;
+  size_t len = 0;
+  const char *p = pathname;
+  while (*p != '\0') {
+    while (*p == '/') p++;
+    if (*p == '\0') break;
+    path[len++] = '/';
+    while (*p != '\0' && *p != '/') path[len++] = *p++;
+    ends[numComponents++] = len;
+  }
+
+  int inumber = ROOT_INUMBER;
+  int next = numComponents;
+  while (next > 0) {
+    int cached = dcache_lookup(fs->dcache, path, ends[next - 1]);
+    if (cached == DCACHE_NEGATIVE) return -1;
+    if (cached > 0) {
+      inumber = cached;
+      break;
+    }
+    next--;
+  }
+
+  for (; next < numComponents; next++) {
+    size_t start = (next == 0) ? 1 : ends[next - 1] + 1;
+    char name[ends[next] - start + 1];
+    memcpy(name, path + start, ends[next] - start);
+    name[ends[next] - start] = '\0';
+
+    struct direntv6 dirEnt;
+    if (directory_findname(fs, name, inumber, &dirEnt) < 0 || dirEnt.d_inumber == 0) {
+      dcache_insert(fs->dcache, path, ends[next], DCACHE_NEGATIVE);
+      return -1;
+    }
+    inumber = dirEnt.d_inumber;
+    dcache_insert(fs->dcache, path, ends[next], inumber);
+  }
+  return inumber;
 }
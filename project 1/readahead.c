@@ -0,0 +1,72 @@
+#include "readahead.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+// Streams tracked at once; an inumber shares its slot with others mod this.
+#define READAHEAD_STREAMS 64
+
+// Window of a stream that has just been found to be sequential.
+#define READAHEAD_MIN_WINDOW 8
+
+struct stream {
+  int inumber;      // file being read, 0 if the slot is unused
+  int nextBlock;    // block a sequential reader will ask for next
+  int window;       // blocks to keep prefetched past nextBlock, 0 if not sequential
+  int prefetchEnd;  // blocks before this have already been prefetched
+};
+
+struct readahead {
+  int maxWindow;
+  struct stream streams[READAHEAD_STREAMS];
+  pthread_mutex_t lock;     // held by every public operation
+};
+
+struct readahead *readahead_create(int maxWindow) {
+  if (maxWindow < 1) return NULL;
+  struct readahead *ra = calloc(1, sizeof(struct readahead));
+  if (ra == NULL) return NULL;
+  ra->maxWindow = maxWindow;
+  pthread_mutex_init(&ra->lock, NULL);
+  return ra;
+}
+
+void readahead_free(struct readahead *ra) {
+  if (ra == NULL) return;
+  pthread_mutex_destroy(&ra->lock);
+  free(ra);
+}
+
+// Window a stream starts with once it is known to be sequential: enough to
+// stay ahead of a reader asking for numBlocks at a time.
+static int initial_window(struct readahead *ra, int numBlocks) {
+  int window = (2 * numBlocks > READAHEAD_MIN_WINDOW) ? 2 * numBlocks : READAHEAD_MIN_WINDOW;
+  return (window > ra->maxWindow) ? ra->maxWindow : window;
+}
+
+int readahead_access(struct readahead *ra, int inumber, int firstBlock, int numBlocks, int *prefetchStart) {
+  pthread_mutex_lock(&ra->lock);
+  struct stream *st = &ra->streams[(unsigned int) inumber % READAHEAD_STREAMS];
+  int endBlock = firstBlock + numBlocks;
+  if (st->inumber == inumber && firstBlock == st->nextBlock) {
+    if (st->window == 0) st->window = initial_window(ra, numBlocks);
+  } else {
+    // A new stream.  Reading from the start of a file is taken as a sign of
+    // a sequential reader right away, as the checksummers always do.
+    st->inumber = inumber;
+    st->window = (firstBlock == 0) ? initial_window(ra, numBlocks) : 0;
+    st->prefetchEnd = endBlock;
+  }
+  st->nextBlock = endBlock;
+
+  // Top the window up once the reader has consumed half of it, and let the
+  // next one grow.
+  int count = 0;
+  if (st->window > 0 && st->prefetchEnd - endBlock <= st->window / 2) {
+    *prefetchStart = (st->prefetchEnd > endBlock) ? st->prefetchEnd : endBlock;
+    count = endBlock + st->window - *prefetchStart;
+    st->prefetchEnd = endBlock + st->window;
+    st->window = (st->window * 2 > ra->maxWindow) ? ra->maxWindow : st->window * 2;
+  }
+  pthread_mutex_unlock(&ra->lock);
+  return count;
+}
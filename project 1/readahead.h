@@ -0,0 +1,34 @@
+#ifndef _READAHEAD_H_
+#define _READAHEAD_H_
+
+/**
+ * Detects files being read sequentially and decides how far ahead of the
+ * reader to prefetch.  A stream is tracked per inumber; while accesses keep
+ * continuing where the previous one ended, the stream's window doubles with
+ * every prefetch, up to a maximum, and any other access resets it.  This
+ * module only does the bookkeeping; the file module issues the prefetches.
+ * All operations are thread safe.
+ */
+
+struct readahead;
+
+/**
+ * Allocates a tracker whose windows grow up to maxWindow blocks.  Returns NULL
+ * if maxWindow is invalid or on out of memory.
+ */
+struct readahead *readahead_create(int maxWindow);
+
+/**
+ * Releases the tracker.
+ */
+void readahead_free(struct readahead *ra);
+
+/**
+ * Records a read of numBlocks file blocks of inumber starting at firstBlock.
+ * If the blocks after it should be prefetched now, sets *prefetchStart to the
+ * first block to prefetch and returns how many; otherwise returns 0.  Blocks
+ * already handed out by an earlier call are not handed out again.
+ */
+int readahead_access(struct readahead *ra, int inumber, int firstBlock, int numBlocks, int *prefetchStart);
+
+#endif // _READAHEAD_H_
@@ -0,0 +1,288 @@
+#include "sectorcache.h"
+#include "diskimg.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define NO_SLOT (-1)
+
+struct slot {
+  int sectorNum;       // sector held in this slot, -1 if empty
+  int hashNext;        // next slot in the same hash bucket
+  int prev;            // LRU list neighbours, most recently used at the head
+  int next;
+  uint8_t referenced;  // CLOCK reference bit
+  uint8_t dirty;       // written with sectorcache_write and not yet flushed
+  char data[DISKIMG_SECTOR_SIZE];
+};
+
+struct sectorcache {
+  int policy;
+  int numSlots;
+  unsigned int bucketMask;  // number of hash buckets minus one
+  int *buckets;
+  struct slot *slots;
+  int hand;                 // CLOCK hand
+  int head;                 // LRU list ends
+  int tail;
+  int numDirty;
+  struct sectorcache_stats stats;
+  pthread_mutex_t lock;     // held by every public operation
+};
+
+static unsigned int hash_sector(struct sectorcache *cache, int sectorNum) {
+  return ((unsigned int) sectorNum * 2654435761u) & cache->bucketMask;
+}
+
+static int find_slot(struct sectorcache *cache, int sectorNum) {
+  int s = cache->buckets[hash_sector(cache, sectorNum)];
+  while (s != NO_SLOT && cache->slots[s].sectorNum != sectorNum) {
+    s = cache->slots[s].hashNext;
+  }
+  return s;
+}
+
+static void hash_remove(struct sectorcache *cache, int s) {
+  int *link = &cache->buckets[hash_sector(cache, cache->slots[s].sectorNum)];
+  while (*link != s) {
+    link = &cache->slots[*link].hashNext;
+  }
+  *link = cache->slots[s].hashNext;
+}
+
+static void hash_insert(struct sectorcache *cache, int s) {
+  int *bucket = &cache->buckets[hash_sector(cache, cache->slots[s].sectorNum)];
+  cache->slots[s].hashNext = *bucket;
+  *bucket = s;
+}
+
+static void lru_unlink(struct sectorcache *cache, int s) {
+  struct slot *sp = &cache->slots[s];
+  if (sp->prev != NO_SLOT) cache->slots[sp->prev].next = sp->next;
+  else cache->head = sp->next;
+  if (sp->next != NO_SLOT) cache->slots[sp->next].prev = sp->prev;
+  else cache->tail = sp->prev;
+}
+
+static void lru_pushfront(struct sectorcache *cache, int s) {
+  struct slot *sp = &cache->slots[s];
+  sp->prev = NO_SLOT;
+  sp->next = cache->head;
+  if (cache->head != NO_SLOT) cache->slots[cache->head].prev = s;
+  cache->head = s;
+  if (cache->tail == NO_SLOT) cache->tail = s;
+}
+
+// Marks slot s as just used according to the eviction policy.
+static void touch(struct sectorcache *cache, int s) {
+  if (cache->policy == SECTORCACHE_LRU) {
+    lru_unlink(cache, s);
+    lru_pushfront(cache, s);
+  } else {
+    cache->slots[s].referenced = 1;
+  }
+}
+
+// Picks the slot to reuse.  Empty slots are never referenced and start out at
+// the LRU tail, so both policies fill the cache before evicting anything.
+// Dirty slots are passed over; returns NO_SLOT if every slot is dirty.
+static int choose_victim(struct sectorcache *cache) {
+  if (cache->policy == SECTORCACHE_LRU) {
+    int s = cache->tail;
+    while (s != NO_SLOT && cache->slots[s].dirty) s = cache->slots[s].prev;
+    return s;
+  }
+  // Two sweeps clear every reference bit, so a clean slot is found by then.
+  for (int steps = 0; steps < 2 * cache->numSlots; steps++) {
+    struct slot *sp = &cache->slots[cache->hand];
+    int victim = cache->hand;
+    cache->hand = (cache->hand + 1) % cache->numSlots;
+    if (sp->referenced) {
+      sp->referenced = 0;
+    } else if (!sp->dirty) {
+      return victim;
+    }
+  }
+  return NO_SLOT;
+}
+
+// Finds the slot for sectorNum, taking over a victim if it isn't cached.
+// Returns NO_SLOT if it isn't cached and every slot is dirty.
+static int claim_slot(struct sectorcache *cache, int sectorNum) {
+  int s = find_slot(cache, sectorNum);
+  if (s != NO_SLOT) return s;
+  s = choose_victim(cache);
+  if (s == NO_SLOT) return NO_SLOT;
+  if (cache->slots[s].sectorNum >= 0) {
+    hash_remove(cache, s);
+    cache->stats.evictions++;
+  }
+  cache->slots[s].sectorNum = sectorNum;
+  hash_insert(cache, s);
+  return s;
+}
+
+struct sectorcache *sectorcache_create(int numSlots, int policy) {
+  if (numSlots < 1) return NULL;
+  if (policy != SECTORCACHE_CLOCK && policy != SECTORCACHE_LRU) return NULL;
+
+  struct sectorcache *cache = malloc(sizeof(struct sectorcache));
+  if (cache == NULL) return NULL;
+
+  int numBuckets = 1;
+  while (numBuckets < numSlots) numBuckets <<= 1;
+
+  cache->policy = policy;
+  cache->numSlots = numSlots;
+  cache->bucketMask = numBuckets - 1;
+  cache->buckets = malloc(numBuckets * sizeof(int));
+  cache->slots = malloc(numSlots * sizeof(struct slot));
+  if (cache->buckets == NULL || cache->slots == NULL) {
+    free(cache->buckets);
+    free(cache->slots);
+    free(cache);
+    return NULL;
+  }
+
+  for (int b = 0; b < numBuckets; b++) {
+    cache->buckets[b] = NO_SLOT;
+  }
+  cache->hand = 0;
+  cache->head = cache->tail = NO_SLOT;
+  cache->numDirty = 0;
+  for (int s = 0; s < numSlots; s++) {
+    cache->slots[s].sectorNum = -1;
+    cache->slots[s].hashNext = NO_SLOT;
+    cache->slots[s].referenced = 0;
+    cache->slots[s].dirty = 0;
+    lru_pushfront(cache, s);
+  }
+  memset(&cache->stats, 0, sizeof(cache->stats));
+  pthread_mutex_init(&cache->lock, NULL);
+  return cache;
+}
+
+void sectorcache_free(struct sectorcache *cache) {
+  if (cache == NULL) return;
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->buckets);
+  free(cache->slots);
+  free(cache);
+}
+
+int sectorcache_lookup(struct sectorcache *cache, int sectorNum, void *buf) {
+  pthread_mutex_lock(&cache->lock);
+  int s = find_slot(cache, sectorNum);
+  if (s == NO_SLOT) {
+    cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+  }
+  cache->stats.hits++;
+  touch(cache, s);
+  memcpy(buf, cache->slots[s].data, DISKIMG_SECTOR_SIZE);
+  pthread_mutex_unlock(&cache->lock);
+  return 1;
+}
+
+void sectorcache_insert(struct sectorcache *cache, int sectorNum, const void *buf) {
+  pthread_mutex_lock(&cache->lock);
+  int s = claim_slot(cache, sectorNum);
+  if (s != NO_SLOT) {
+    struct slot *sp = &cache->slots[s];
+    memcpy(sp->data, buf, DISKIMG_SECTOR_SIZE);
+    if (sp->dirty) {
+      // buf was just written through, so it is what the disk holds now.
+      sp->dirty = 0;
+      cache->numDirty--;
+    }
+    touch(cache, s);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void sectorcache_fill(struct sectorcache *cache, int sectorNum, void *buf) {
+  pthread_mutex_lock(&cache->lock);
+  int s = claim_slot(cache, sectorNum);
+  if (s != NO_SLOT) {
+    struct slot *sp = &cache->slots[s];
+    // A write can land between the caller's miss and this fill; the disk
+    // doesn't have it yet.
+    if (sp->dirty) {
+      memcpy(buf, sp->data, DISKIMG_SECTOR_SIZE);
+    } else {
+      memcpy(sp->data, buf, DISKIMG_SECTOR_SIZE);
+    }
+    touch(cache, s);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+int sectorcache_write(struct sectorcache *cache, int sectorNum, const void *buf) {
+  pthread_mutex_lock(&cache->lock);
+  int s = claim_slot(cache, sectorNum);
+  if (s != NO_SLOT) {
+    struct slot *sp = &cache->slots[s];
+    memcpy(sp->data, buf, DISKIMG_SECTOR_SIZE);
+    if (!sp->dirty) {
+      sp->dirty = 1;
+      cache->numDirty++;
+    }
+    touch(cache, s);
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return (s == NO_SLOT) ? -1 : 0;
+}
+
+int sectorcache_lookupdirty(struct sectorcache *cache, int sectorNum, void *buf) {
+  pthread_mutex_lock(&cache->lock);
+  int s = find_slot(cache, sectorNum);
+  int dirty = (s != NO_SLOT && cache->slots[s].dirty);
+  if (dirty) memcpy(buf, cache->slots[s].data, DISKIMG_SECTOR_SIZE);
+  pthread_mutex_unlock(&cache->lock);
+  return dirty;
+}
+
+int sectorcache_numdirty(struct sectorcache *cache) {
+  pthread_mutex_lock(&cache->lock);
+  int numDirty = cache->numDirty;
+  pthread_mutex_unlock(&cache->lock);
+  return numDirty;
+}
+
+static int compare_sectors(const void *a, const void *b) {
+  return *(const int *) a - *(const int *) b;
+}
+
+int sectorcache_getdirty(struct sectorcache *cache, int maxSectors, int *sectorNums, void *data) {
+  pthread_mutex_lock(&cache->lock);
+  int count = 0;
+  for (int s = 0; s < cache->numSlots && count < maxSectors; s++) {
+    if (cache->slots[s].dirty) sectorNums[count++] = cache->slots[s].sectorNum;
+  }
+  qsort(sectorNums, count, sizeof(int), compare_sectors);
+  for (int i = 0; i < count; i++) {
+    memcpy((char *) data + (size_t) i * DISKIMG_SECTOR_SIZE,
+           cache->slots[find_slot(cache, sectorNums[i])].data, DISKIMG_SECTOR_SIZE);
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return count;
+}
+
+void sectorcache_markclean(struct sectorcache *cache, const int *sectorNums, int numSectors) {
+  pthread_mutex_lock(&cache->lock);
+  for (int i = 0; i < numSectors; i++) {
+    int s = find_slot(cache, sectorNums[i]);
+    if (s != NO_SLOT && cache->slots[s].dirty) {
+      cache->slots[s].dirty = 0;
+      cache->numDirty--;
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void sectorcache_getstats(struct sectorcache *cache, struct sectorcache_stats *stats) {
+  pthread_mutex_lock(&cache->lock);
+  *stats = cache->stats;
+  pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,93 @@
+#ifndef _SECTORCACHE_H_
+#define _SECTORCACHE_H_
+
+#include <stdint.h>
+
+/**
+ * A fixed-size cache of disk sectors used by the diskimg module.  Each slot
+ * holds one DISKIMG_SECTOR_SIZE sector; when all slots are in use a victim is
+ * chosen with either the CLOCK (second chance) or the LRU policy.
+ *
+ * Sectors stored with sectorcache_write are dirty: they are never evicted
+ * until the owner has written them to the disk and called
+ * sectorcache_markclean.  The cache itself does no I/O.
+ */
+
+#define SECTORCACHE_CLOCK 0
+#define SECTORCACHE_LRU   1
+
+struct sectorcache_stats {
+  uint64_t hits;       // lookups satisfied from the cache
+  uint64_t misses;     // lookups that had to go to the disk
+  uint64_t evictions;  // valid sectors dropped to make room for another
+};
+
+struct sectorcache;
+
+/**
+ * Allocates a cache with numSlots sector slots that evicts using the given
+ * policy.  Returns NULL if numSlots or policy is invalid or on out of memory.
+ */
+struct sectorcache *sectorcache_create(int numSlots, int policy);
+
+/**
+ * Releases all memory held by the cache.
+ */
+void sectorcache_free(struct sectorcache *cache);
+
+/**
+ * Copies the cached contents of sectorNum into buf.  Returns 1 on a hit and 0
+ * on a miss, in which case buf is left untouched.
+ */
+int sectorcache_lookup(struct sectorcache *cache, int sectorNum, void *buf);
+
+/**
+ * Stores the contents of sectorNum, which match what is on the disk, in the
+ * cache, replacing the cached copy if there is one and evicting another
+ * sector if the cache is full.  If every slot is dirty nothing is cached.
+ */
+void sectorcache_insert(struct sectorcache *cache, int sectorNum, const void *buf);
+
+/**
+ * Like sectorcache_insert, for contents just read from the disk: if the cache
+ * holds a dirty copy of sectorNum, that copy is newer, so it is kept and
+ * copied into buf instead.
+ */
+void sectorcache_fill(struct sectorcache *cache, int sectorNum, void *buf);
+
+/**
+ * Stores new contents for sectorNum in the cache and marks it dirty.  Returns
+ * 0 on success, or -1 if sectorNum isn't cached and every slot is dirty, in
+ * which case the dirty sectors must be flushed first.
+ */
+int sectorcache_write(struct sectorcache *cache, int sectorNum, const void *buf);
+
+/**
+ * Copies the cached contents of sectorNum into buf if they are dirty.
+ * Returns 1 if they were copied, 0 otherwise.  Doesn't count as a use.
+ */
+int sectorcache_lookupdirty(struct sectorcache *cache, int sectorNum, void *buf);
+
+/**
+ * Returns the number of dirty sectors.
+ */
+int sectorcache_numdirty(struct sectorcache *cache);
+
+/**
+ * Copies up to maxSectors dirty sectors out of the cache, in increasing
+ * sector order: their numbers into sectorNums and their contents into data,
+ * one after the other.  They stay dirty.  Returns the number copied.
+ */
+int sectorcache_getdirty(struct sectorcache *cache, int maxSectors, int *sectorNums, void *data);
+
+/**
+ * Marks the given sectors clean once they have been written to the disk.
+ */
+void sectorcache_markclean(struct sectorcache *cache, const int *sectorNums, int numSectors);
+
+/**
+ * Copies the hit/miss/eviction counters into stats.
+ */
+void sectorcache_getstats(struct sectorcache *cache, struct sectorcache_stats *stats);
+
+#endif // _SECTORCACHE_H_
@@ -0,0 +1,121 @@
+#include "unixfilesystem.h"
+#include "diskimg.h"
+#include "dirindex.h"
+#include "dcache.h"
+#include "readahead.h"
+#include "iostats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Sectors of I list fetched per read when building the inode table.
+#define ITABLE_READ_SECTORS 256
+
+// Paths remembered by the dentry cache before it starts over.
+#define DCACHE_ENTRIES 65536
+
+// Largest read-ahead window, in blocks.
+#define READAHEAD_MAX_BLOCKS 512
+
+// Reads the whole I list into fs->itable with a few large sequential reads.
+static int load_itable(struct unixfilesystem *fs) {
+  int numSectors = fs->superblock.s_isize;
+  int inodesPerSector = DISKIMG_SECTOR_SIZE / sizeof(struct inode);
+  fs->itable = malloc((size_t) numSectors * DISKIMG_SECTOR_SIZE);
+  if (fs->itable == NULL) return -1;
+
+  for (int s = 0; s < numSectors; s += ITABLE_READ_SECTORS) {
+    int n = (numSectors - s < ITABLE_READ_SECTORS) ? numSectors - s : ITABLE_READ_SECTORS;
+    int bytesRead = iostats_readsectors(fs, IOSITE_FS_ITABLE, INODE_START_SECTOR + s, n,
+                                        fs->itable + s * inodesPerSector);
+    if (bytesRead != n * DISKIMG_SECTOR_SIZE) {
+      free(fs->itable);
+      fs->itable = NULL;
+      return -1;
+    }
+  }
+  fs->ninodes = numSectors * inodesPerSector;
+  return 0;
+}
+
+// Frees everything hanging off fs without syncing, for the init error paths
+// where the superblock may not have been read.
+static void release(struct unixfilesystem *fs) {
+  dirindex_free(fs->dirindex);
+  dcache_free(fs->dcache);
+  readahead_free(fs->readahead);
+  iostats_free(fs->iostats);
+  free(fs->itable);
+  free(fs);
+}
+
+struct unixfilesystem *unixfilesystem_init(int dfd) {
+  return unixfilesystem_initflags(dfd, 0);
+}
+
+struct unixfilesystem *unixfilesystem_initflags(int dfd, int flags) {
+  if ((flags & UNIXFILESYSTEM_MMAP) && diskimg_mmap(dfd) < 0) {
+    fprintf(stderr, "Error mapping disk image\n");
+    return NULL;
+  }
+
+  uint16_t bootblock[DISKIMG_SECTOR_SIZE / sizeof(uint16_t)];
+  if (diskimg_readsector(dfd, BOOTBLOCK_SECTOR, bootblock) != DISKIMG_SECTOR_SIZE) {
+    fprintf(stderr, "Error reading bootblock\n");
+    return NULL;
+  }
+
+  if (bootblock[0] != BOOTBLOCK_MAGIC_NUM) {
+    fprintf(stderr, "Bad magic number on disk(0x%x)\n", bootblock[0]);
+    return NULL;
+  }
+
+  struct unixfilesystem *fs = malloc(sizeof(struct unixfilesystem));
+  if (fs == NULL) {
+    fprintf(stderr, "Out of memory.\n");
+    return NULL;
+  }
+  fs->dfd = dfd;
+  fs->flags = flags;
+  fs->itable = NULL;
+  fs->ninodes = 0;
+  fs->dirindex = dirindex_create();
+  fs->dcache = dcache_create(DCACHE_ENTRIES);
+  fs->manifest = NULL;
+  fs->readahead = (flags & UNIXFILESYSTEM_READAHEAD) ? readahead_create(READAHEAD_MAX_BLOCKS) : NULL;
+  fs->iostats = iostats_create(dfd);
+
+  if (iostats_readsector(fs, IOSITE_FS_INIT, SUPERBLOCK_SECTOR, &fs->superblock) != DISKIMG_SECTOR_SIZE) {
+    fprintf(stderr, "Error reading superblock\n");
+    release(fs);
+    return NULL;
+  }
+  // Only our own changes should make unixfilesystem_sync() write.
+  fs->superblock.s_fmod = 0;
+
+  if ((flags & UNIXFILESYSTEM_ITABLE) && load_itable(fs) < 0) {
+    fprintf(stderr, "Error reading I list\n");
+    release(fs);
+    return NULL;
+  }
+  return fs;
+}
+
+int unixfilesystem_sync(struct unixfilesystem *fs) {
+  if (!fs->superblock.s_fmod) return diskimg_flush(fs->dfd);
+  uint32_t now = time(NULL);
+  fs->superblock.s_fmod = 0;
+  fs->superblock.s_time[0] = now >> 16;
+  fs->superblock.s_time[1] = now & 0xffff;
+  if (iostats_writesector(fs, IOSITE_FS_SYNC, SUPERBLOCK_SECTOR, &fs->superblock) != DISKIMG_SECTOR_SIZE) {
+    fs->superblock.s_fmod = 1;
+    fprintf(stderr, "Error writing superblock\n");
+    return -1;
+  }
+  return diskimg_flush(fs->dfd);
+}
+
+void unixfilesystem_free(struct unixfilesystem *fs) {
+  unixfilesystem_sync(fs);
+  release(fs);
+}
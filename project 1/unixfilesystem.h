@@ -25,11 +25,46 @@
 #define ROOT_INUMBER        1
 #define BOOTBLOCK_MAGIC_NUM 0407
 
+/**
+ * Flags accepted by unixfilesystem_initflags().
+ */
+#define UNIXFILESYSTEM_MMAP   0x1   // Access the disk image through mmap rather than pread.
+#define UNIXFILESYSTEM_ITABLE 0x2   // Load the whole I list into memory at init time.
+#define UNIXFILESYSTEM_READAHEAD 0x4 // Prefetch ahead of files being read sequentially.
+
 struct unixfilesystem {
   int dfd; // Handle from the diskimg module to read the diskimg.
   struct filsys superblock;  // The superblock read from the diskimage.
+  int flags;                 // UNIXFILESYSTEM_* flags the filesystem was set up with.
+  struct inode *itable;      // In-memory copy of the I list (UNIXFILESYSTEM_ITABLE), or NULL.
+  int ninodes;               // Number of inodes in itable.
+  struct dirindex *dirindex; // Hash indexes of large directories, built as they are searched.
+  struct dcache *dcache;     // Path prefix to inumber cache used by pathname_lookup.
+  struct readahead *readahead; // Sequential read detection (UNIXFILESYSTEM_READAHEAD), or NULL.
+  struct manifest *manifest; // Checksums reused by chksumfile_byinumber, or NULL.  Owned by the caller.
+  struct iostats *iostats;   // Counts (and optionally traces) the sector I/O done through this filesystem.
 };
 
 struct unixfilesystem *unixfilesystem_init(int fd);
 
+/**
+ * Same as unixfilesystem_init(), with flags selecting how the disk image is
+ * accessed.  Returns NULL on error.
+ */
+struct unixfilesystem *unixfilesystem_initflags(int fd, int flags);
+
+/**
+ * Writes the superblock back to the disk if the allocator has changed it,
+ * then flushes a write-back disk image.  Allocations only mark the in-memory
+ * copy modified, so any number of them cost one superblock write.  Returns 0
+ * on success, -1 on error.
+ */
+int unixfilesystem_sync(struct unixfilesystem *fs);
+
+/**
+ * Releases a filesystem returned by unixfilesystem_init*(), syncing it first.
+ * The disk image itself is left open.
+ */
+void unixfilesystem_free(struct unixfilesystem *fs);
+
 #endif // _UNIXFILESYSTEM_H_
@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+
+#include "diskimg.h"
+#include "unixfilesystem.h"
+#include "inode.h"
+#include "file.h"
+#include "directory.h"
+#include "pathname.h"
+#include "alloc.h"
+#include "dump.h"
+
+int cacheSlots = 0;
+int cachePolicy = SECTORCACHE_CLOCK;
+int fsFlags = 0;
+int numOps = 100000;
+int regenerate = 0;
+FILE *devNull = NULL;   // where the timed dumps write their lines
+
+/**
+ * Shape of the synthetic image.  It holds a deep tree, /deep/d00/.../d39 with
+ * a small file in each directory; a huge directory, /big, with BIG_ENTRIES
+ * one block files; and /large, with a large file that needs only singly
+ * indirect blocks and one big enough to need the doubly indirect block.
+ */
+#define IMAGE_BLOCKS     60000
+#define IMAGE_IBLOCKS    400     // 16 inodes per block
+#define DEEP_LEVELS      40
+#define BIG_ENTRIES      4000
+#define LARGE_SMALL_SIZE (512 * 1024)
+#define LARGE_BIG_SIZE   (12 * 1024 * 1024)
+#define WRITE_CHUNK      (64 * 1024)
+#define GEN_CACHE_SLOTS  4096    // sector cache used while generating
+
+static void PrintUsageAndExit(char *progname);
+
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fills buf with bytes that depend on the file and the offset.
+static void FillPattern(char *buf, int len, int inumber, int offset) {
+  for (int i = 0; i < len; i++) {
+    buf[i] = (char) ((inumber * 131 + offset + i) * 2654435761u >> 24);
+  }
+}
+
+static int WriteFile(struct unixfilesystem *fs, int inumber, int size) {
+  static char buf[WRITE_CHUNK];
+  for (int offset = 0; offset < size; offset += WRITE_CHUNK) {
+    int len = (size - offset < WRITE_CHUNK) ? size - offset : WRITE_CHUNK;
+    FillPattern(buf, len, inumber, offset);
+    if (file_write(fs, inumber, offset, len, buf) != len) return -1;
+  }
+  return 0;
+}
+
+// Adds 1 to the link count of inumber.
+static int AddLink(struct unixfilesystem *fs, int inumber) {
+  struct inode in;
+  if (inode_iget(fs, inumber, &in) < 0) return -1;
+  in.i_nlink++;
+  return inode_iput(fs, inumber, &in);
+}
+
+/**
+ * Creates directory name in parent, with its "." and ".." entries.  Returns
+ * its inumber, or -1 on error.
+ */
+static int MakeDirectory(struct unixfilesystem *fs, int parent, const char *name) {
+  int inumber = alloc_inode(fs, IFDIR | 0755);
+  if (inumber < 0) return -1;
+  if (directory_addentry(fs, inumber, ".", inumber) < 0 ||
+      directory_addentry(fs, inumber, "..", parent) < 0 ||
+      directory_addentry(fs, parent, name, inumber) < 0) {
+    return -1;
+  }
+  // One link from the parent and one from ".", and the parent gains "..".
+  if (AddLink(fs, inumber) < 0 || AddLink(fs, parent) < 0) return -1;
+  return inumber;
+}
+
+/**
+ * Creates a regular file name of size bytes in directory parent.  Returns its
+ * inumber, or -1 on error.
+ */
+static int MakeFile(struct unixfilesystem *fs, int parent, const char *name, int size) {
+  int inumber = alloc_inode(fs, 0644);
+  if (inumber < 0) return -1;
+  if (WriteFile(fs, inumber, size) < 0 || directory_addentry(fs, parent, name, inumber) < 0) return -1;
+  return inumber;
+}
+
+/**
+ * Writes an empty filesystem to the image open on fd: a boot block, the
+ * superblock, a zeroed I list, and every data block on the free list, freed
+ * from the top down so files are laid out in increasing block order.  The
+ * root directory is inode 1.
+ */
+static struct unixfilesystem *FormatImage(int fd) {
+  char buf[DISKIMG_SECTOR_SIZE];
+  memset(buf, 0, sizeof(buf));
+  for (int s = 0; s < INODE_START_SECTOR + IMAGE_IBLOCKS; s++) {
+    if (diskimg_writesector(fd, s, buf) != DISKIMG_SECTOR_SIZE) return NULL;
+  }
+  if (ftruncate(fd, (off_t) IMAGE_BLOCKS * DISKIMG_SECTOR_SIZE) < 0) return NULL;
+
+  uint16_t *bootblock = (uint16_t *) buf;
+  bootblock[0] = BOOTBLOCK_MAGIC_NUM;
+  if (diskimg_writesector(fd, BOOTBLOCK_SECTOR, buf) != DISKIMG_SECTOR_SIZE) return NULL;
+  struct filsys sb;
+  memset(&sb, 0, sizeof(sb));
+  sb.s_isize = IMAGE_IBLOCKS;
+  sb.s_fsize = IMAGE_BLOCKS;
+  if (diskimg_writesector(fd, SUPERBLOCK_SECTOR, &sb) != DISKIMG_SECTOR_SIZE) return NULL;
+
+  struct unixfilesystem *fs = unixfilesystem_init(fd);
+  if (fs == NULL) return NULL;
+  for (int b = IMAGE_BLOCKS - 1; b >= INODE_START_SECTOR + IMAGE_IBLOCKS; b--) {
+    if (alloc_freeblock(fs, b) < 0) return NULL;
+  }
+
+  struct inode root;
+  memset(&root, 0, sizeof(root));
+  root.i_mode = IALLOC | IFDIR | 0755;
+  root.i_nlink = 2;
+  if (inode_iput(fs, ROOT_INUMBER, &root) < 0 ||
+      directory_addentry(fs, ROOT_INUMBER, ".", ROOT_INUMBER) < 0 ||
+      directory_addentry(fs, ROOT_INUMBER, "..", ROOT_INUMBER) < 0) {
+    return NULL;
+  }
+  return fs;
+}
+
+/**
+ * Generates the synthetic image described above at path.  The image is
+ * written back through the sector cache, so it is populated with a few large
+ * sorted flushes instead of a write per sector; the flushes are journaled in
+ * path plus ".journal", which is removed once the image is complete.
+ * Returns 0 on success, -1 on error.
+ */
+static int GenerateImage(char *path) {
+  char journalPath[strlen(path) + sizeof(".journal")];
+  sprintf(journalPath, "%s.journal", path);
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || close(fd) < 0) return -1;
+  // A journal left by an earlier generation belongs to the old image.
+  if (unlink(journalPath) < 0 && errno != ENOENT) return -1;
+  fd = diskimg_open(path, 0);
+  if (fd < 0 || diskimg_setcache(fd, GEN_CACHE_SLOTS, SECTORCACHE_CLOCK) < 0 ||
+      diskimg_setwriteback(fd, journalPath) < 0) {
+    return -1;
+  }
+  struct unixfilesystem *fs = FormatImage(fd);
+  if (fs == NULL) return -1;
+
+  char name[16];
+  int dir = MakeDirectory(fs, ROOT_INUMBER, "deep");
+  for (int level = 0; level < DEEP_LEVELS && dir >= 0; level++) {
+    snprintf(name, sizeof(name), "d%02d", level);
+    dir = MakeDirectory(fs, dir, name);
+    if (dir >= 0 && MakeFile(fs, dir, "f", 100 + level * 37) < 0) dir = -1;
+  }
+  if (dir < 0) return -1;
+
+  int big = MakeDirectory(fs, ROOT_INUMBER, "big");
+  if (big < 0) return -1;
+  for (int i = 0; i < BIG_ENTRIES; i++) {
+    snprintf(name, sizeof(name), "f%04d", i);
+    if (MakeFile(fs, big, name, DISKIMG_SECTOR_SIZE) < 0) return -1;
+  }
+
+  int large = MakeDirectory(fs, ROOT_INUMBER, "large");
+  if (large < 0 || MakeFile(fs, large, "small", LARGE_SMALL_SIZE) < 0 ||
+      MakeFile(fs, large, "big", LARGE_BIG_SIZE) < 0) {
+    return -1;
+  }
+
+  if (unixfilesystem_sync(fs) < 0) return -1;
+  unixfilesystem_free(fs);
+  if (diskimg_close(fd) < 0) return -1;
+  return unlink(journalPath);
+}
+
+/**
+ * Times numOps calls of op.  Every benchmark gets the filesystem, the call's
+ * index and its own state.
+ */
+typedef int (*benchop)(struct unixfilesystem *fs, int i, void *arg);
+
+static void RunBenchmark(struct unixfilesystem *fs, const char *name, benchop op, void *arg, int n) {
+  struct diskimg_iostats before, after;
+  diskimg_getiostats(fs->dfd, &before);
+  double start = Now();
+  int errors = 0;
+  for (int i = 0; i < n; i++) {
+    if (op(fs, i, arg) < 0) errors++;
+  }
+  double elapsed = Now() - start;
+  diskimg_getiostats(fs->dfd, &after);
+
+  printf("%-20s %9d %12.0f %12.2f %12.2f", name, n, n / elapsed,
+         (double) (after.sectors - before.sectors) / n, (double) (after.syscalls - before.syscalls) / n);
+  if (errors > 0) printf("  (%d errors)", errors);
+  printf("\n");
+}
+
+// A fixed pseudo-random sequence, so every run does the same work.
+static unsigned int Random(int i) {
+  unsigned int x = i * 2654435761u + 0x9e3779b9u;
+  x ^= x >> 16;
+  x *= 0x85ebca6bu;
+  x ^= x >> 13;
+  return x;
+}
+
+struct fileinfo {
+  int inumber;
+  struct inode in;
+  int numBlocks;
+};
+
+static int IgetOp(struct unixfilesystem *fs, int i, void *arg) {
+  int numInodes = *(int *) arg;
+  struct inode in;
+  return inode_iget(fs, 1 + Random(i) % numInodes, &in);
+}
+
+static int IndexLookupOp(struct unixfilesystem *fs, int i, void *arg) {
+  struct fileinfo *f = arg;
+  return inode_indexlookup(fs, &f->in, Random(i) % f->numBlocks);
+}
+
+static int GetBlockOp(struct unixfilesystem *fs, int i, void *arg) {
+  struct fileinfo *f = arg;
+  char buf[DISKIMG_SECTOR_SIZE];
+  return file_getblock(fs, f->inumber, i % f->numBlocks, buf);
+}
+
+static int FindNameOp(struct unixfilesystem *fs, int i, void *arg) {
+  int dirinumber = *(int *) arg;
+  char name[16];
+  struct direntv6 dirEnt;
+  snprintf(name, sizeof(name), "f%04d", Random(i) % BIG_ENTRIES);
+  return directory_findname(fs, name, dirinumber, &dirEnt);
+}
+
+// Alternates between the files of the deep tree and those of /big.
+static int LookupOp(struct unixfilesystem *fs, int i, void *arg) {
+  char path[8 + DEEP_LEVELS * 4 + 2];
+  unsigned int r = Random(i);
+  if (r & 1) {
+    snprintf(path, sizeof(path), "/big/f%04d", (r >> 1) % BIG_ENTRIES);
+  } else {
+    int depth = 1 + (r >> 1) % DEEP_LEVELS;
+    int len = snprintf(path, sizeof(path), "/deep");
+    for (int level = 0; level < depth; level++) {
+      len += snprintf(path + len, sizeof(path) - len, "/d%02d", level);
+    }
+    snprintf(path + len, sizeof(path) - len, "/f");
+  }
+  return pathname_lookup(fs, path);
+}
+
+// One pass of diskimageaccess -i, serial and with the linear checksum.
+static int InodeDumpOp(struct unixfilesystem *fs, int i, void *arg) {
+  return dump_inodes(fs, arg, devNull);
+}
+
+// One pass of diskimageaccess -p.
+static int PathDumpOp(struct unixfilesystem *fs, int i, void *arg) {
+  return dump_paths(fs, arg, devNull);
+}
+
+static int GetFileInfo(struct unixfilesystem *fs, const char *path, struct fileinfo *f) {
+  f->inumber = pathname_lookup(fs, path);
+  if (f->inumber < 0 || inode_iget(fs, f->inumber, &f->in) < 0) return -1;
+  f->numBlocks = (inode_getsize(&f->in) + DISKIMG_SECTOR_SIZE - 1) / DISKIMG_SECTOR_SIZE;
+  return f->numBlocks > 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "c:lmtrn:g")) != -1) {
+    switch (opt) {
+    case 'c':
+      cacheSlots = atoi(optarg);
+      break;
+    case 'l':
+      cachePolicy = SECTORCACHE_LRU;
+      break;
+    case 'm':
+      fsFlags |= UNIXFILESYSTEM_MMAP;
+      break;
+    case 't':
+      fsFlags |= UNIXFILESYSTEM_ITABLE;
+      break;
+    case 'r':
+      fsFlags |= UNIXFILESYSTEM_READAHEAD;
+      break;
+    case 'n':
+      numOps = atoi(optarg);
+      if (numOps < 1) PrintUsageAndExit(argv[0]);
+      break;
+    case 'g':
+      regenerate = 1;
+      break;
+    default:
+      PrintUsageAndExit(argv[0]);
+    }
+  }
+
+  if (optind != argc-1) {
+    PrintUsageAndExit(argv[0]);
+  }
+
+  char *diskpath = argv[optind];
+  if (regenerate || access(diskpath, F_OK) < 0) {
+    double start = Now();
+    if (GenerateImage(diskpath) < 0) {
+      fprintf(stderr, "Can't generate %s\n", diskpath);
+      exit(EXIT_FAILURE);
+    }
+    printf("Generated %s in %.2f s\n", diskpath, Now() - start);
+  }
+
+  int fd = diskimg_open(diskpath, 1);
+  if (fd < 0) {
+    fprintf(stderr, "Can't open diskimagePath %s\n", diskpath);
+    exit(EXIT_FAILURE);
+  }
+  if (cacheSlots > 0 && diskimg_setcache(fd, cacheSlots, cachePolicy) < 0) {
+    fprintf(stderr, "Can't set up a %d sector cache\n", cacheSlots);
+    exit(EXIT_FAILURE);
+  }
+  struct unixfilesystem *fs = unixfilesystem_initflags(fd, fsFlags);
+  if (!fs) {
+    fprintf(stderr, "Failed to initialize unix filesystem\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int numInodes = fs->superblock.s_isize * (DISKIMG_SECTOR_SIZE / sizeof(struct inode));
+  int bigDir = pathname_lookup(fs, "/big");
+  struct fileinfo largeFile;
+  if (bigDir < 0 || GetFileInfo(fs, "/large/big", &largeFile) < 0) {
+    fprintf(stderr, "%s is not a v6bench image; regenerate it with -g\n", diskpath);
+    exit(EXIT_FAILURE);
+  }
+
+  printf("Options: cache %d slots %s%s%s%s\n", cacheSlots, cachePolicy == SECTORCACHE_LRU ? "LRU" : "CLOCK",
+         (fsFlags & UNIXFILESYSTEM_MMAP) ? ", mmap" : "", (fsFlags & UNIXFILESYSTEM_ITABLE) ? ", itable" : "",
+         (fsFlags & UNIXFILESYSTEM_READAHEAD) ? ", readahead" : "");
+  printf("%-20s %9s %12s %12s %12s\n", "benchmark", "ops", "ops/sec", "sectors/op", "syscalls/op");
+  RunBenchmark(fs, "inode_iget", IgetOp, &numInodes, numOps);
+  RunBenchmark(fs, "inode_indexlookup", IndexLookupOp, &largeFile, numOps);
+  RunBenchmark(fs, "directory_findname", FindNameOp, &bigDir, numOps);
+  RunBenchmark(fs, "pathname_lookup", LookupOp, NULL, numOps);
+  RunBenchmark(fs, "file_getblock", GetBlockOp, &largeFile, numOps);
+  devNull = fopen("/dev/null", "w");
+  if (devNull == NULL) {
+    fprintf(stderr, "Can't open /dev/null\n");
+    exit(EXIT_FAILURE);
+  }
+  struct dump_options dumpOptions = { 1, 0 };
+  RunBenchmark(fs, "dump -i", InodeDumpOp, &dumpOptions, 1);
+  RunBenchmark(fs, "dump -p", PathDumpOp, &dumpOptions, 1);
+  fclose(devNull);
+
+  unixfilesystem_free(fs);
+  if (diskimg_close(fd) < 0) fprintf(stderr, "Error closing %s\n", diskpath);
+  exit(EXIT_SUCCESS);
+  return 0;
+}
+
+static void PrintUsageAndExit(char *progname) {
+  fprintf(stderr, "Usage: %s <options> diskimagePath\n", progname);
+  fprintf(stderr, "where <options> can be:\n");
+  fprintf(stderr, "-c N   cache N sectors\n");
+  fprintf(stderr, "-l     evict cached sectors LRU rather than CLOCK\n");
+  fprintf(stderr, "-m     memory map the disk image\n");
+  fprintf(stderr, "-t     load the I list into memory\n");
+  fprintf(stderr, "-r     read ahead of sequential file reads\n");
+  fprintf(stderr, "-n N   time N calls of each function (default 100000)\n");
+  fprintf(stderr, "-g     generate the synthetic image even if diskimagePath exists\n");
+  fprintf(stderr, "The synthetic image is generated first if diskimagePath doesn't exist.\n");
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "diskimg.h"
+#include "unixfilesystem.h"
+#include "inode.h"
+#include "directory.h"
+#include "bitmap.h"
+#include "alloc.h"
+#include "freemap.h"
+
+int quietFlag = 0;
+int numThreads = 1;
+
+// Inodes handed to a worker at a time by the parallel passes.
+#define INODE_CHUNK 256
+
+/**
+ * What the checker has learned about the image.  The passes over the I list
+ * and the directories fill it in from several threads at once: the bitmaps
+ * are updated atomically, refs with atomic adds, and each inode's nlink by
+ * the one thread that owns its chunk.
+ */
+struct fsck {
+  struct unixfilesystem *fs;
+  int numInodes;
+  int firstDataBlock;          // blocks [firstDataBlock, numBlocks) hold data
+  int numBlocks;
+  struct bitmap *usedBlocks;   // claimed by an inode
+  struct bitmap *dupBlocks;    // claimed more than once
+  struct bitmap *freeBlocks;   // on the free list
+  struct bitmap *allocInodes;  // IALLOC set
+  struct bitmap *dirInodes;    // allocated directories
+  uint8_t *nlink;              // i_nlink of each inode, indexed by inumber
+  uint32_t *refs;              // directory entries naming each inode
+  int problems;
+};
+
+static void PrintUsageAndExit(char *progname);
+
+// Reports a problem with the image.
+static void Problem(struct fsck *ck, FILE *out, const char *fmt, ...) {
+  __atomic_fetch_add(&ck->problems, 1, __ATOMIC_RELAXED);
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(out, fmt, args);
+  va_end(args);
+}
+
+static int BlockInRange(struct fsck *ck, int blockNum) {
+  return blockNum >= ck->firstDataBlock && blockNum < ck->numBlocks;
+}
+
+/**
+ * Called for every block an inode claims, indirect blocks included.  Returns
+ * 1 if the block may be read, 0 if it is out of range.
+ */
+typedef int (*blockvisitor)(struct fsck *ck, int inumber, int blockNum, FILE *out);
+
+/**
+ * Calls visit for each block of the file: the data blocks that its size
+ * covers and the indirect blocks that map them.  Zero addresses are holes
+ * and are skipped.
+ */
+static void ForEachBlock(struct fsck *ck, int inumber, const struct inode *in, blockvisitor visit, FILE *out) {
+  int size = inode_getsize(in);
+  int numFileBlocks = (size + DISKIMG_SECTOR_SIZE - 1) / DISKIMG_SECTOR_SIZE;
+  int numAddrs = sizeof(in->i_addr) / sizeof(in->i_addr[0]);
+
+  if (!(in->i_mode & ILARG)) {
+    if (numFileBlocks > numAddrs) {
+      Problem(ck, out, "Inode %d: size %d is too big for a small file\n", inumber, size);
+      numFileBlocks = numAddrs;
+    }
+    for (int i = 0; i < numFileBlocks; i++) {
+      if (in->i_addr[i] != 0) visit(ck, inumber, in->i_addr[i], out);
+    }
+    return;
+  }
+
+  int numGroups = (numFileBlocks + ADDRS_PER_BLOCK - 1) / ADDRS_PER_BLOCK;
+  uint16_t doublyBuf[ADDRS_PER_BLOCK];
+  const uint16_t *doubly = NULL;
+  if (numGroups > NUM_INDIRECT_ADDRS && in->i_addr[NUM_INDIRECT_ADDRS] != 0 &&
+      visit(ck, inumber, in->i_addr[NUM_INDIRECT_ADDRS], out)) {
+    doubly = diskimg_sectorref(ck->fs->dfd, in->i_addr[NUM_INDIRECT_ADDRS], doublyBuf);
+    if (doubly == NULL) Problem(ck, out, "Inode %d: can't read block %d\n", inumber, in->i_addr[NUM_INDIRECT_ADDRS]);
+  }
+
+  for (int g = 0; g < numGroups; g++) {
+    int indirBlockNum;
+    if (g < NUM_INDIRECT_ADDRS) {
+      indirBlockNum = in->i_addr[g];
+    } else if (g - NUM_INDIRECT_ADDRS < ADDRS_PER_BLOCK) {
+      if (doubly == NULL) break;
+      indirBlockNum = doubly[g - NUM_INDIRECT_ADDRS];
+    } else {
+      Problem(ck, out, "Inode %d: size %d is too big for a large file\n", inumber, size);
+      break;
+    }
+    if (indirBlockNum == 0 || !visit(ck, inumber, indirBlockNum, out)) continue;
+
+    uint16_t indirBuf[ADDRS_PER_BLOCK];
+    const uint16_t *indir = diskimg_sectorref(ck->fs->dfd, indirBlockNum, indirBuf);
+    if (indir == NULL) {
+      Problem(ck, out, "Inode %d: can't read block %d\n", inumber, indirBlockNum);
+      continue;
+    }
+    int n = numFileBlocks - g * ADDRS_PER_BLOCK;
+    if (n > ADDRS_PER_BLOCK) n = ADDRS_PER_BLOCK;
+    for (int i = 0; i < n; i++) {
+      if (indir[i] != 0) visit(ck, inumber, indir[i], out);
+    }
+  }
+}
+
+// Pass 1 visitor: marks the block used, remembering blocks claimed twice.
+static int ClaimBlock(struct fsck *ck, int inumber, int blockNum, FILE *out) {
+  if (!BlockInRange(ck, blockNum)) {
+    Problem(ck, out, "Inode %d: block %d is out of range\n", inumber, blockNum);
+    return 0;
+  }
+  if (bitmap_set(ck->usedBlocks, blockNum)) bitmap_set(ck->dupBlocks, blockNum);
+  return 1;
+}
+
+// Pass 1b visitor: names every claimant of a block claimed twice.
+static int ReportDuplicate(struct fsck *ck, int inumber, int blockNum, FILE *out) {
+  if (!BlockInRange(ck, blockNum)) return 0;
+  if (bitmap_test(ck->dupBlocks, blockNum)) {
+    Problem(ck, out, "Block %d is claimed by inode %d and another inode\n", blockNum, inumber);
+  }
+  return 1;
+}
+
+/**
+ * Fetches the inodes [first, end) in one batch.  Returns 0 on success, or -1
+ * after reporting the problem.
+ */
+static int FetchInodes(struct fsck *ck, int first, int end, struct inode *inodes, FILE *out) {
+  int inumbers[INODE_CHUNK];
+  for (int i = first; i < end; i++) {
+    inumbers[i - first] = i;
+  }
+  if (inode_iget_batch(ck->fs, inumbers, end - first, inodes) < 0) {
+    Problem(ck, out, "Can't read inodes %d to %d\n", first, end - 1);
+    return -1;
+  }
+  return 0;
+}
+
+// Pass 1: records which inodes are allocated and which blocks they claim.
+static void CheckInodes(struct fsck *ck, int first, int end, FILE *out) {
+  struct inode inodes[INODE_CHUNK];
+  if (FetchInodes(ck, first, end, inodes, out) < 0) return;
+  for (int inumber = first; inumber < end; inumber++) {
+    const struct inode *in = &inodes[inumber - first];
+    if (!(in->i_mode & IALLOC)) continue;
+    bitmap_set(ck->allocInodes, inumber);
+    if ((in->i_mode & IFMT) == IFDIR) bitmap_set(ck->dirInodes, inumber);
+    ck->nlink[inumber] = in->i_nlink;
+    if ((in->i_mode & IFMT) == IFCHR || (in->i_mode & IFMT) == IFBLK) continue;  // i_addr holds a device number
+    ForEachBlock(ck, inumber, in, ClaimBlock, out);
+  }
+}
+
+// Pass 1b: only run when some block was claimed twice.
+static void FindDuplicates(struct fsck *ck, int first, int end, FILE *out) {
+  struct inode inodes[INODE_CHUNK];
+  if (FetchInodes(ck, first, end, inodes, out) < 0) return;
+  for (int inumber = first; inumber < end; inumber++) {
+    const struct inode *in = &inodes[inumber - first];
+    if (!bitmap_test(ck->allocInodes, inumber)) continue;
+    if ((in->i_mode & IFMT) == IFCHR || (in->i_mode & IFMT) == IFBLK) continue;
+    ForEachBlock(ck, inumber, in, ReportDuplicate, out);
+  }
+}
+
+// Pass 2: counts the directory entries naming each inode.
+static void CheckDirectories(struct fsck *ck, int first, int end, FILE *out) {
+  for (int inumber = first; inumber < end; inumber++) {
+    if (!bitmap_test(ck->dirInodes, inumber)) continue;
+    struct directory_iter it;
+    if (directory_open(ck->fs, inumber, &it) < 0) {
+      Problem(ck, out, "Directory %d: can't be read\n", inumber);
+      continue;
+    }
+    const struct direntv6 *dir;
+    int err;
+    while ((err = directory_next(&it, &dir)) > 0) {
+      int child = dir->d_inumber;
+      int namelen = sizeof(dir->d_name);
+      if (child == 0) continue;  // empty slot
+      if (child > ck->numInodes) {
+        Problem(ck, out, "Directory %d: entry %.*s has bad inumber %d\n", inumber, namelen, dir->d_name, child);
+        continue;
+      }
+      if (!bitmap_test(ck->allocInodes, child)) {
+        Problem(ck, out, "Directory %d: entry %.*s names free inode %d\n", inumber, namelen, dir->d_name, child);
+        continue;
+      }
+      if (strncmp(dir->d_name, ".", namelen) == 0 && child != inumber) {
+        Problem(ck, out, "Directory %d: entry . names inode %d\n", inumber, child);
+      }
+      __atomic_fetch_add(&ck->refs[child], 1, __ATOMIC_RELAXED);
+    }
+    if (err < 0) Problem(ck, out, "Directory %d: can't be read\n", inumber);
+    directory_close(&it);
+  }
+}
+
+typedef void (*inodepass)(struct fsck *ck, int first, int end, FILE *out);
+
+/**
+ * State of one parallel pass.  Workers claim chunks of INODE_CHUNK inumbers
+ * in order and collect each chunk's reports in memory; they are printed in
+ * chunk order afterwards, so the output doesn't depend on the thread count.
+ */
+struct passrun {
+  struct fsck *ck;
+  inodepass pass;
+  int numChunks;
+  int nextChunk;
+  char **outputs;
+  size_t *outputLens;
+  pthread_mutex_t lock;
+};
+
+static void *PassWorker(void *arg) {
+  struct passrun *run = arg;
+  while (1) {
+    pthread_mutex_lock(&run->lock);
+    int c = run->nextChunk++;
+    pthread_mutex_unlock(&run->lock);
+    if (c >= run->numChunks) return NULL;
+
+    FILE *out = open_memstream(&run->outputs[c], &run->outputLens[c]);
+    if (out == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+    int first = 1 + c * INODE_CHUNK;
+    int end = (first + INODE_CHUNK <= run->ck->numInodes + 1) ? first + INODE_CHUNK : run->ck->numInodes + 1;
+    run->pass(run->ck, first, end, out);
+    fclose(out);
+  }
+}
+
+// Runs pass over every inumber on numThreads threads.
+static void RunPass(struct fsck *ck, inodepass pass) {
+  struct passrun run;
+  run.ck = ck;
+  run.pass = pass;
+  run.numChunks = (ck->numInodes + INODE_CHUNK - 1) / INODE_CHUNK;
+  run.nextChunk = 0;
+  run.outputs = calloc(run.numChunks + 1, sizeof(char *));
+  run.outputLens = calloc(run.numChunks + 1, sizeof(size_t));
+  if (run.outputs == NULL || run.outputLens == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_mutex_init(&run.lock, NULL);
+
+  pthread_t threads[numThreads];
+  int numStarted = 0;
+  while (numStarted < numThreads - 1 &&
+         pthread_create(&threads[numStarted], NULL, PassWorker, &run) == 0) {
+    numStarted++;
+  }
+  PassWorker(&run);
+  for (int t = 0; t < numStarted; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  for (int c = 0; c < run.numChunks; c++) {
+    fwrite(run.outputs[c], 1, run.outputLens[c], stdout);
+    free(run.outputs[c]);
+  }
+  free(run.outputs);
+  free(run.outputLens);
+  pthread_mutex_destroy(&run.lock);
+}
+
+// Pass 3: compares the link counts with the directory entries found.
+static void CheckLinkCounts(struct fsck *ck) {
+  for (int inumber = 1; inumber <= ck->numInodes; inumber++) {
+    if (!bitmap_test(ck->allocInodes, inumber)) continue;
+    if (ck->refs[inumber] == 0) {
+      Problem(ck, stdout, "Inode %d is not in any directory\n", inumber);
+    } else if (ck->refs[inumber] != ck->nlink[inumber]) {
+      Problem(ck, stdout, "Inode %d: link count %d, should be %u\n", inumber, ck->nlink[inumber], ck->refs[inumber]);
+    }
+  }
+}
+
+// Records blockNum, which freemap_walk found on the free list, as free.
+// Returns -1 to stop the walk at a link that can't be followed.
+static int MarkFree(int blockNum, int isLink, void *arg) {
+  struct fsck *ck = arg;
+  if (!BlockInRange(ck, blockNum)) {
+    Problem(ck, stdout, "Free list: block %d is out of range\n", blockNum);
+    return isLink ? -1 : 0;
+  }
+  if (bitmap_set(ck->freeBlocks, blockNum)) {
+    Problem(ck, stdout, "Free list: block %d is listed twice\n", blockNum);
+    return isLink ? -1 : 0;
+  }
+  if (bitmap_test(ck->usedBlocks, blockNum)) {
+    Problem(ck, stdout, "Free list: block %d is in use\n", blockNum);
+  }
+  return 0;
+}
+
+// Pass 4: follows the free list and the free inode cache.
+static void CheckFreeLists(struct fsck *ck) {
+  struct filsys *sb = &ck->fs->superblock;
+  int bad;
+  int err = freemap_walk(ck->fs, MarkFree, ck, &bad);
+  if (err == FREEMAP_WALK_BADCOUNT) {
+    Problem(ck, stdout, "Free list: bad count %d\n", bad);
+  } else if (err == FREEMAP_WALK_BADREAD) {
+    Problem(ck, stdout, "Free list: can't read block %d\n", bad);
+  }
+
+  int missing = 0;
+  for (int b = ck->firstDataBlock; b < ck->numBlocks; b++) {
+    if (!bitmap_test(ck->usedBlocks, b) && !bitmap_test(ck->freeBlocks, b)) missing++;
+  }
+  if (missing > 0) {
+    Problem(ck, stdout, "%d blocks are neither in use nor on the free list\n", missing);
+  }
+
+  if (sb->s_ninode > NICINOD) {
+    Problem(ck, stdout, "Free inode list: bad count %d\n", sb->s_ninode);
+    return;
+  }
+  for (int i = 0; i < sb->s_ninode; i++) {
+    int inumber = sb->s_inode[i];
+    if (inumber < 1 || inumber > ck->numInodes) {
+      Problem(ck, stdout, "Free inode list: bad inumber %d\n", inumber);
+    } else if (bitmap_test(ck->allocInodes, inumber)) {
+      Problem(ck, stdout, "Free inode list: inode %d is in use\n", inumber);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "qj:")) != -1) {
+    switch (opt) {
+    case 'q':
+      quietFlag = 1;
+      break;
+    case 'j':
+      numThreads = atoi(optarg);
+      if (numThreads < 1) PrintUsageAndExit(argv[0]);
+      break;
+    default:
+      PrintUsageAndExit(argv[0]);
+    }
+  }
+
+  if (optind != argc-1) {
+    PrintUsageAndExit(argv[0]);
+  }
+
+  char *diskpath = argv[optind];
+  int fd = diskimg_open(diskpath, 1);
+  if (fd < 0) {
+    fprintf(stderr, "Can't open diskimagePath %s\n", diskpath);
+    exit(EXIT_FAILURE);
+  }
+  struct unixfilesystem *fs = unixfilesystem_init(fd);
+  if (!fs) {
+    fprintf(stderr, "Failed to initialize unix filesystem\n");
+    exit(EXIT_FAILURE);
+  }
+
+  struct fsck ck;
+  ck.fs = fs;
+  ck.numInodes = fs->superblock.s_isize * (DISKIMG_SECTOR_SIZE / sizeof(struct inode));
+  ck.firstDataBlock = INODE_START_SECTOR + fs->superblock.s_isize;
+  ck.numBlocks = fs->superblock.s_fsize;
+  ck.usedBlocks = bitmap_create(ck.numBlocks);
+  ck.dupBlocks = bitmap_create(ck.numBlocks);
+  ck.freeBlocks = bitmap_create(ck.numBlocks);
+  ck.allocInodes = bitmap_create(ck.numInodes + 1);
+  ck.dirInodes = bitmap_create(ck.numInodes + 1);
+  ck.nlink = calloc(ck.numInodes + 1, sizeof(uint8_t));
+  ck.refs = calloc(ck.numInodes + 1, sizeof(uint32_t));
+  ck.problems = 0;
+  if (ck.usedBlocks == NULL || ck.dupBlocks == NULL || ck.freeBlocks == NULL ||
+      ck.allocInodes == NULL || ck.dirInodes == NULL || ck.nlink == NULL || ck.refs == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  RunPass(&ck, CheckInodes);
+  if (bitmap_count(ck.dupBlocks) > 0) RunPass(&ck, FindDuplicates);
+  if (!bitmap_test(ck.dirInodes, ROOT_INUMBER)) {
+    Problem(&ck, stdout, "Root inode %d is not a directory\n", ROOT_INUMBER);
+  }
+  RunPass(&ck, CheckDirectories);
+  CheckLinkCounts(&ck);
+  CheckFreeLists(&ck);
+
+  if (!quietFlag) {
+    printf("%d inodes in use, %d blocks in use, %d blocks free\n", bitmap_count(ck.allocInodes),
+           bitmap_count(ck.usedBlocks), bitmap_count(ck.freeBlocks));
+  }
+  if (ck.problems > 0) {
+    printf("%d problems found in %s\n", ck.problems, diskpath);
+  } else if (!quietFlag) {
+    printf("No problems found in %s\n", diskpath);
+  }
+
+  bitmap_free(ck.usedBlocks);
+  bitmap_free(ck.dupBlocks);
+  bitmap_free(ck.freeBlocks);
+  bitmap_free(ck.allocInodes);
+  bitmap_free(ck.dirInodes);
+  free(ck.nlink);
+  free(ck.refs);
+  unixfilesystem_free(fs);
+  diskimg_close(fd);
+  exit(ck.problems > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+  return 0;
+}
+
+static void PrintUsageAndExit(char *progname) {
+  fprintf(stderr, "Usage: %s <options> diskimagePath\n", progname);
+  fprintf(stderr, "where <options> can be:\n");
+  fprintf(stderr, "-q     only print problems\n");
+  fprintf(stderr, "-j N   use N threads for the inode and directory passes\n");
+  exit(EXIT_FAILURE);
+}
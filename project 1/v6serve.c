@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+
+#include "diskimg.h"
+#include "unixfilesystem.h"
+#include "inode.h"
+#include "file.h"
+#include "directory.h"
+#include "pathname.h"
+#include "v6serve.h"
+
+int cacheSlots = 0;
+int cachePolicy = SECTORCACHE_CLOCK;
+int fsFlags = 0;
+int quietFlag = 0;
+
+// The one filesystem every connection reads.
+static struct unixfilesystem *fs;
+static char *socketPath;
+
+static void PrintUsageAndExit(char *progname);
+
+/**
+ * Reads exactly len bytes from fd.  Returns 1 on success, 0 if the peer
+ * closed the connection first, and -1 on error.
+ */
+static int ReadFully(int fd, void *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = read(fd, (char *) buf + done, len - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return -1;
+    if (n == 0) return 0;
+    done += n;
+  }
+  return 1;
+}
+
+// Sends a response and its payload with one system call where possible.
+static int SendResponse(int fd, int status, void *payload, size_t len) {
+  struct v6serve_response resp = { status, (status < 0) ? 0 : len };
+  struct iovec iov[2] = { { &resp, sizeof(resp) }, { payload, resp.len } };
+  int iovcnt = (resp.len > 0) ? 2 : 1;
+  size_t total = sizeof(resp) + resp.len;
+  size_t done = 0;
+  while (done < total) {
+    ssize_t n = writev(fd, iov, iovcnt);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    done += n;
+    // Skip over what went out.
+    while (iovcnt > 0 && (size_t) n >= iov[0].iov_len) {
+      n -= iov[0].iov_len;
+      iov[0] = iov[1];
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov[0].iov_base = (char *) iov[0].iov_base + n;
+      iov[0].iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Looks up path and fetches its inode.  Returns the inumber, or a negative
+ * errno value.
+ */
+static int LookupInode(const char *path, struct inode *in) {
+  if (path[0] != '/') return -EINVAL;
+  int inumber = pathname_lookup(fs, path);
+  if (inumber <= 0) return -ENOENT;
+  if (inode_iget(fs, inumber, in) < 0) return -EIO;
+  if (!(in->i_mode & IALLOC)) return -ENOENT;
+  return inumber;
+}
+
+static int HandleStat(int fd, const char *path) {
+  struct inode in;
+  int inumber = LookupInode(path, &in);
+  if (inumber < 0) return SendResponse(fd, inumber, NULL, 0);
+
+  struct v6serve_stat st;
+  memset(&st, 0, sizeof(st));
+  st.inumber = inumber;
+  st.size = inode_getsize(&in);
+  st.mtime = ((uint32_t) in.i_mtime[0] << 16) | in.i_mtime[1];
+  st.mode = in.i_mode;
+  st.nlink = in.i_nlink;
+  st.uid = in.i_uid;
+  st.gid = in.i_gid;
+  return SendResponse(fd, 0, &st, sizeof(st));
+}
+
+static int HandleReaddir(int fd, const char *path, uint32_t offset, uint32_t count) {
+  struct inode in;
+  int inumber = LookupInode(path, &in);
+  if (inumber < 0) return SendResponse(fd, inumber, NULL, 0);
+  if ((in.i_mode & IFMT) != IFDIR) return SendResponse(fd, -ENOTDIR, NULL, 0);
+  if (count == 0 || count > V6SERVE_MAX_ENTRIES) count = V6SERVE_MAX_ENTRIES;
+
+  struct direntv6 *entries = malloc(count * sizeof(struct direntv6));
+  if (entries == NULL) return SendResponse(fd, -EIO, NULL, 0);
+  struct directory_iter it;
+  if (directory_open(fs, inumber, &it) < 0) {
+    free(entries);
+    return SendResponse(fd, -EIO, NULL, 0);
+  }
+  const struct direntv6 *dir;
+  uint32_t numEntries = 0;
+  uint32_t skipped = 0;
+  int err;
+  while (numEntries < count && (err = directory_next(&it, &dir)) > 0) {
+    if (dir->d_inumber == 0) continue;
+    if (skipped < offset) {
+      skipped++;
+      continue;
+    }
+    entries[numEntries++] = *dir;
+  }
+  directory_close(&it);
+
+  int result = (err < 0) ? SendResponse(fd, -EIO, NULL, 0)
+                         : SendResponse(fd, 0, entries, numEntries * sizeof(struct direntv6));
+  free(entries);
+  return result;
+}
+
+static int HandleRead(int fd, const char *path, uint32_t offset, uint32_t count) {
+  struct inode in;
+  int inumber = LookupInode(path, &in);
+  if (inumber < 0) return SendResponse(fd, inumber, NULL, 0);
+  if ((in.i_mode & IFMT) == IFDIR) return SendResponse(fd, -EISDIR, NULL, 0);
+  if (count == 0 || count > V6SERVE_MAX_READ) count = V6SERVE_MAX_READ;
+
+  uint32_t size = inode_getsize(&in);
+  if (offset >= size) return SendResponse(fd, 0, NULL, 0);
+  if (count > size - offset) count = size - offset;
+  char buf[V6SERVE_MAX_READ];
+  int n = file_read(fs, inumber, offset, count, buf);
+  if (n < 0) return SendResponse(fd, -EIO, NULL, 0);
+  return SendResponse(fd, 0, buf, n);
+}
+
+// Answers the requests of one client until it disconnects.
+static void *ServeConnection(void *arg) {
+  int fd = (int) (intptr_t) arg;
+  struct v6serve_request req;
+  char path[V6SERVE_MAX_PATH + 1];
+  while (ReadFully(fd, &req, sizeof(req)) > 0) {
+    if (req.pathLen > V6SERVE_MAX_PATH) {
+      // The stream can't be resynchronized past a path we won't read.
+      SendResponse(fd, -EINVAL, NULL, 0);
+      break;
+    }
+    if (ReadFully(fd, path, req.pathLen) <= 0) break;
+    path[req.pathLen] = '\0';
+
+    int err;
+    switch (req.op) {
+    case V6SERVE_STAT:
+      err = HandleStat(fd, path);
+      break;
+    case V6SERVE_READDIR:
+      err = HandleReaddir(fd, path, req.offset, req.count);
+      break;
+    case V6SERVE_READ:
+      err = HandleRead(fd, path, req.offset, req.count);
+      break;
+    default:
+      err = SendResponse(fd, -EINVAL, NULL, 0);
+    }
+    if (err < 0) break;
+  }
+  close(fd);
+  return NULL;
+}
+
+static void RemoveSocket(int sig) {
+  unlink(socketPath);
+  _exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "qc:lmtr")) != -1) {
+    switch (opt) {
+    case 'q':
+      quietFlag = 1;
+      break;
+    case 'c':
+      cacheSlots = atoi(optarg);
+      break;
+    case 'l':
+      cachePolicy = SECTORCACHE_LRU;
+      break;
+    case 'm':
+      fsFlags |= UNIXFILESYSTEM_MMAP;
+      break;
+    case 't':
+      fsFlags |= UNIXFILESYSTEM_ITABLE;
+      break;
+    case 'r':
+      fsFlags |= UNIXFILESYSTEM_READAHEAD;
+      break;
+    default:
+      PrintUsageAndExit(argv[0]);
+    }
+  }
+
+  if (optind != argc-2) {
+    PrintUsageAndExit(argv[0]);
+  }
+
+  char *diskpath = argv[optind];
+  socketPath = argv[optind + 1];
+  int dfd = diskimg_open(diskpath, 1);
+  if (dfd < 0) {
+    fprintf(stderr, "Can't open diskimagePath %s\n", diskpath);
+    exit(EXIT_FAILURE);
+  }
+  if (cacheSlots > 0 && diskimg_setcache(dfd, cacheSlots, cachePolicy) < 0) {
+    fprintf(stderr, "Can't set up a %d sector cache\n", cacheSlots);
+    exit(EXIT_FAILURE);
+  }
+  fs = unixfilesystem_initflags(dfd, fsFlags);
+  if (!fs) {
+    fprintf(stderr, "Failed to initialize unix filesystem\n");
+    exit(EXIT_FAILURE);
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path %s is too long\n", socketPath);
+    exit(EXIT_FAILURE);
+  }
+  strcpy(addr.sun_path, socketPath);
+  int sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  unlink(socketPath);
+  if (sfd < 0 || bind(sfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(sfd, SOMAXCONN) < 0) {
+    perror(socketPath);
+    exit(EXIT_FAILURE);
+  }
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, RemoveSocket);
+  signal(SIGTERM, RemoveSocket);
+  if (!quietFlag) fprintf(stderr, "Serving %s on %s\n", diskpath, socketPath);
+
+  // One thread per connection; the library's read paths are thread safe.
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  while (1) {
+    int cfd = accept(sfd, NULL, NULL);
+    if (cfd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      perror("accept");
+      break;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, ServeConnection, (void *) (intptr_t) cfd) != 0) {
+      fprintf(stderr, "Can't start a thread for a connection\n");
+      close(cfd);
+    }
+  }
+
+  unlink(socketPath);
+  unixfilesystem_free(fs);
+  diskimg_close(dfd);
+  exit(EXIT_FAILURE);
+  return 0;
+}
+
+static void PrintUsageAndExit(char *progname) {
+  fprintf(stderr, "Usage: %s <options> diskimagePath socketPath\n", progname);
+  fprintf(stderr, "where <options> can be:\n");
+  fprintf(stderr, "-q     don't print extra info\n");
+  fprintf(stderr, "-c N   cache up to N disk sectors in memory\n");
+  fprintf(stderr, "-l     evict cached sectors in LRU order instead of CLOCK\n");
+  fprintf(stderr, "-m     memory map the disk image instead of reading it sector by sector\n");
+  fprintf(stderr, "-t     load the whole inode table into memory up front\n");
+  fprintf(stderr, "-r     prefetch ahead of files being read sequentially\n");
+  fprintf(stderr, "Answers stat, readdir and read requests (see v6serve.h) until killed.\n");
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,58 @@
+#ifndef _V6SERVE_H_
+#define _V6SERVE_H_
+
+#include <stdint.h>
+
+/**
+ * Protocol spoken by v6serve over its Unix domain stream socket.  A client
+ * sends any number of requests on a connection, one at a time; each is a
+ * v6serve_request followed by pathLen bytes of absolute path (not null
+ * terminated).  The server answers each with a v6serve_response followed by
+ * len bytes of payload.  All integers are in host byte order, since both
+ * ends are on the same machine.
+ *
+ *   V6SERVE_STAT     payload is a struct v6serve_stat.
+ *   V6SERVE_READDIR  payload is up to count struct direntv6 entries (see
+ *                    direntv6.h), skipping the first offset entries in use.
+ *                    An empty payload means the end of the directory.
+ *   V6SERVE_READ     payload is up to count bytes of the file starting at
+ *                    byte offset; shorter only at the end of the file.
+ *
+ * A count of 0, or one above the maximum, asks for the maximum.  On error
+ * status is a negative errno value (ENOENT, ENOTDIR, EISDIR, EINVAL or EIO)
+ * and there is no payload.
+ */
+
+#define V6SERVE_STAT    1
+#define V6SERVE_READDIR 2
+#define V6SERVE_READ    3
+
+#define V6SERVE_MAX_PATH    1024
+#define V6SERVE_MAX_READ    (64 * 1024)  // bytes per V6SERVE_READ
+#define V6SERVE_MAX_ENTRIES 4096         // entries per V6SERVE_READDIR
+
+struct v6serve_request {
+  uint8_t op;
+  uint8_t pad;
+  uint16_t pathLen;
+  uint32_t offset;
+  uint32_t count;
+};
+
+struct v6serve_response {
+  int32_t status;
+  uint32_t len;
+};
+
+struct v6serve_stat {
+  uint32_t inumber;
+  uint32_t size;
+  uint32_t mtime;
+  uint16_t mode;
+  uint8_t nlink;
+  uint8_t uid;
+  uint8_t gid;
+  uint8_t pad[3];
+};
+
+#endif // _V6SERVE_H_
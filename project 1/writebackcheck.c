@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "diskimg.h"
+
+/**
+ * Checks the write-back mode of the diskimg module on a scratch image:
+ * writes stay in the cache until a flush, a flush reaches the image and
+ * empties the journal, a journal committed by a flush that never reached the
+ * image is replayed on reopen, a torn journal record is dropped, and a stale
+ * read can't replace a dirty cached sector.  Prints one line per check and
+ * exits with status 1 if any failed.
+ */
+
+#define CHECK_SECTORS 64
+#define CHECK_SLOTS   16
+
+static char *imagePath;
+static char journalPath[1024];
+static int numFailed = 0;
+
+static void PrintUsageAndExit(char *progname);
+
+static void Report(const char *check, int ok) {
+  printf("%-50s %s\n", check, ok ? "ok" : "FAILED");
+  if (!ok) numFailed++;
+}
+
+// Fills buf with a pattern that depends on the sector and a generation.
+static void FillSector(char *buf, int sectorNum, int gen) {
+  for (int i = 0; i < DISKIMG_SECTOR_SIZE; i++) {
+    buf[i] = (char) (sectorNum * 7 + gen * 31 + i);
+  }
+}
+
+// Returns whether the image file itself, read around the diskimg module,
+// holds generation gen of sectors [first, first + num).
+static int ImageHolds(int first, int num, int gen) {
+  int fd = open(imagePath, O_RDONLY);
+  if (fd < 0) return 0;
+  char want[DISKIMG_SECTOR_SIZE];
+  char got[DISKIMG_SECTOR_SIZE];
+  int ok = 1;
+  for (int s = first; ok && s < first + num; s++) {
+    FillSector(want, s, gen);
+    ok = pread(fd, got, sizeof(got), (off_t) s * DISKIMG_SECTOR_SIZE) == sizeof(got) &&
+         memcmp(want, got, sizeof(got)) == 0;
+  }
+  close(fd);
+  return ok;
+}
+
+static off_t JournalSize(void) {
+  struct stat st;
+  return (stat(journalPath, &st) < 0) ? -1 : st.st_size;
+}
+
+// Creates the scratch image with generation 0 in every sector and no journal.
+static int CreateImage(void) {
+  unlink(journalPath);
+  int fd = open(imagePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return -1;
+  char buf[DISKIMG_SECTOR_SIZE];
+  for (int s = 0; s < CHECK_SECTORS; s++) {
+    FillSector(buf, s, 0);
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      close(fd);
+      return -1;
+    }
+  }
+  return close(fd);
+}
+
+// Opens the image in write-back mode, replaying any journal.
+static int OpenWriteback(int readOnly) {
+  int fd = diskimg_open(imagePath, readOnly);
+  if (fd < 0) return -1;
+  if (diskimg_setcache(fd, CHECK_SLOTS, SECTORCACHE_CLOCK) < 0 || diskimg_setwriteback(fd, journalPath) < 0) {
+    diskimg_close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Writes generation gen of sectors [first, first + num) through diskimg.
+static int WriteSectors(int fd, int first, int num, int gen) {
+  char buf[DISKIMG_SECTOR_SIZE];
+  for (int s = first; s < first + num; s++) {
+    FillSector(buf, s, gen);
+    if (diskimg_writesector(fd, s, buf) != DISKIMG_SECTOR_SIZE) return -1;
+  }
+  return 0;
+}
+
+static void CheckFlush(void) {
+  int fd = OpenWriteback(0);
+  int wrote = (fd >= 0 && WriteSectors(fd, 8, 4, 1) == 0);
+  Report("writes stay in the cache until a flush", wrote && ImageHolds(8, 4, 0));
+
+  char buf[DISKIMG_SECTOR_SIZE];
+  char want[DISKIMG_SECTOR_SIZE];
+  FillSector(want, 9, 1);
+  Report("reads see unflushed writes", wrote && diskimg_readsector(fd, 9, buf) == DISKIMG_SECTOR_SIZE &&
+         memcmp(buf, want, sizeof(buf)) == 0);
+
+  int flushed = wrote && diskimg_flush(fd) == 0;
+  Report("a flush reaches the image", flushed && ImageHolds(8, 4, 1) && ImageHolds(0, 8, 0));
+  Report("a flush empties the journal", flushed && JournalSize() == 0);
+  if (fd >= 0) diskimg_close(fd);
+}
+
+/**
+ * Leaves a committed journal record for generation gen of sectors [first,
+ * first + num) that never reached the image.  The image is opened read only,
+ * so the flush commits the record and then fails to write the image, just as
+ * if the system had crashed at that point.
+ */
+static int CommitWithoutApplying(int first, int num, int gen) {
+  int fd = OpenWriteback(1);
+  if (fd < 0) return -1;
+  int committed = WriteSectors(fd, first, num, gen) == 0 && diskimg_flush(fd) < 0 && JournalSize() > 0;
+  diskimg_close(fd);
+  return committed ? 0 : -1;
+}
+
+static void CheckReplay(void) {
+  int committed = CommitWithoutApplying(16, 6, 2) == 0;
+  Report("an interrupted flush leaves the image alone", committed && ImageHolds(16, 6, 0));
+
+  int fd = committed ? OpenWriteback(0) : -1;
+  Report("a committed journal is replayed on reopen", fd >= 0 && ImageHolds(16, 6, 2) && JournalSize() == 0);
+  if (fd >= 0) diskimg_close(fd);
+}
+
+static void CheckTornRecord(void) {
+  off_t size;
+  int torn = CommitWithoutApplying(32, 3, 3) == 0 && (size = JournalSize()) > 0 && truncate(journalPath, size - 1) == 0;
+  int fd = torn ? OpenWriteback(0) : -1;
+  Report("a torn journal record is dropped", fd >= 0 && ImageHolds(32, 3, 0) && JournalSize() == 0);
+  if (fd >= 0) diskimg_close(fd);
+}
+
+static void CheckStaleFill(void) {
+  struct sectorcache *cache = sectorcache_create(CHECK_SLOTS, SECTORCACHE_CLOCK);
+  char stale[DISKIMG_SECTOR_SIZE];
+  char fresh[DISKIMG_SECTOR_SIZE];
+  char buf[DISKIMG_SECTOR_SIZE];
+  FillSector(stale, 5, 0);
+  FillSector(fresh, 5, 4);
+  int ok = cache != NULL && sectorcache_write(cache, 5, fresh) == 0;
+  if (ok) {
+    // What a read that missed before the write would bring back.
+    memcpy(buf, stale, sizeof(buf));
+    sectorcache_fill(cache, 5, buf);
+    ok = memcmp(buf, fresh, sizeof(buf)) == 0 && sectorcache_lookupdirty(cache, 5, buf) &&
+         memcmp(buf, fresh, sizeof(buf)) == 0;
+  }
+  Report("a stale read doesn't replace a dirty sector", ok);
+  sectorcache_free(cache);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) PrintUsageAndExit(argv[0]);
+  imagePath = argv[1];
+  if (snprintf(journalPath, sizeof(journalPath), "%s.journal", imagePath) >= (int) sizeof(journalPath)) {
+    fprintf(stderr, "Image path %s is too long\n", imagePath);
+    exit(EXIT_FAILURE);
+  }
+  if (CreateImage() < 0) {
+    fprintf(stderr, "Can't create %s\n", imagePath);
+    exit(EXIT_FAILURE);
+  }
+
+  CheckFlush();
+  CheckReplay();
+  CheckTornRecord();
+  CheckStaleFill();
+
+  unlink(imagePath);
+  unlink(journalPath);
+  exit(numFailed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+  return 0;
+}
+
+static void PrintUsageAndExit(char *progname) {
+  fprintf(stderr, "Usage: %s scratchImagePath\n", progname);
+  fprintf(stderr, "Checks write-back caching and journal replay on a scratch image, which is\n");
+  fprintf(stderr, "created and removed, along with scratchImagePath.journal.\n");
+  exit(EXIT_FAILURE);
+}
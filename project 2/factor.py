@@ -1,5 +1,5 @@
 #!/usr/bin/env python
-import sys, os, signal, math, time
+import sys, os, signal, math, time, struct
 
 # This line is equivalent to the C syscall: prctl(PR_SET_PDEATHSIG, SIGKILL);
 # It causes the OS to send this process a SIGKILL when its parent process (most likely ./farm)
@@ -26,14 +26,44 @@ def factorization(num):
     factors = map(lambda num: str(num), factors)
     return '%d = %s' % (original, ' * '.join(factors))
 
+# With --framed, requests and responses are frames: a 4-byte big-endian
+# length followed by that many bytes of text.  A request holds a batch of
+# numbers, one per line.  Its response starts with a line giving the seconds
+# spent answering the batch, followed by the lines that would otherwise be
+# printed for the numbers, in the same order.  The worker runs until its
+# input ends, and never stops itself.
+def readFrame():
+    header = sys.stdin.read(4)
+    if len(header) < 4: return None
+    length, = struct.unpack('>I', header)
+    payload = sys.stdin.read(length)
+    if len(payload) < length: return None
+    return payload
+
+def writeFrame(payload):
+    sys.stdout.write(struct.pack('>I', len(payload)) + payload)
+    sys.stdout.flush()
+
+def describe(num):
+    start = time.time()
+    response = factorization(num)
+    stop = time.time()
+    return '%s [pid: %d, time: %g seconds]' % (response, pid, stop - start)
+
 self_halting = len(sys.argv) > 1 and sys.argv[1] == '--self-halting'
+framed = len(sys.argv) > 1 and sys.argv[1] == '--framed'
 pid = os.getpid()
+if framed:
+    while True:
+        request = readFrame()
+        if request is None: break
+        start = time.time()
+        lines = [describe(int(num)) for num in request.split('\n')]
+        writeFrame('\n'.join(['%.9f' % (time.time() - start)] + lines))
+    sys.exit(0)
+
 while True:
     if self_halting: os.kill(pid, signal.SIGSTOP)
     try: num = int(raw_input()) 
     except EOFError: break;
-    start = time.time()
-    response = factorization(num)
-    stop = time.time()
-    print '%s [pid: %d, time: %g seconds]' % (response, pid, stop - start)
-    
+    print describe(num)
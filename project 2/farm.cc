@@ -3,10 +3,18 @@
 #include <cctype>
 #include <cstdio>
 #include <iostream>
+#include <chrono>
+#include <algorithm>
 #include <cstdlib>
 #include <vector>
+#include <map>
+#include <string>
+#include <cerrno>
+#include <cstring>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <arpa/inet.h>
 #include <unistd.h>
 #include <unordered_map>
 #include <sched.h>
@@ -16,9 +24,14 @@ using namespace std;
 
 struct worker {
   worker() {}
-  worker(char *argv[]) : sp(subprocess(argv, true, false)), available(false) {}
+  worker(char *argv[], bool framed) : sp(subprocess(argv, true, framed)), available(false), started(false) {}
   subprocess_t sp;
   bool available;
+  // In pool mode, the batch the worker is factoring.
+  size_t batch;
+  size_t batchSize;
+  chrono::steady_clock::time_point sent;
+  bool started;    // has answered a batch, so is past its own startup
 };
 
 static const size_t kNumCPUs = sysconf(_SC_NPROCESSORS_ONLN);
@@ -39,7 +52,8 @@ static void markWorkersAsAvailable(int sig) {
 }
 
 static const char *kWorkerArguments[] = {"./factor.py", "--self-halting", NULL};
-static void spawnAllWorkers() {
+static const char *kPoolWorkerArguments[] = {"./factor.py", "--framed", NULL};
+static void spawnAllWorkers(bool pool) {
   cout << "There are this many CPUs: " << kNumCPUs << ", numbered 0 through " << kNumCPUs - 1 << "." << endl;
   // Block signals
   sigset_t mask;
@@ -48,7 +62,7 @@ static void spawnAllWorkers() {
   sigprocmask(SIG_BLOCK, &mask, NULL); 
 
   for (size_t i = 0; i < kNumCPUs; i++) {
-    workers[i] = worker((char **) kWorkerArguments);
+    workers[i] = worker((char **) (pool ? kPoolWorkerArguments : kWorkerArguments), pool);
     PID[workers[i].sp.pid]= i;
     cpu_set_t cpu_set;
     CPU_ZERO(&cpu_set);
@@ -79,15 +93,19 @@ static size_t getAvailableWorker() {
   return -1;
 }
 
-static void broadcastNumbersToWorkers() {
-  while (true) {
-    string line;
-    getline(cin, line);
-    if (cin.fail()) break;
-    size_t endpos;
-    long long num = stoll(line, &endpos);
-    if (endpos != line.size()) break;
+// Reads the next number to factor, returning false at the end of the input.
+static bool readNumber(long long& num) {
+  string line;
+  getline(cin, line);
+  if (cin.fail()) return false;
+  size_t endpos;
+  num = stoll(line, &endpos);
+  return endpos == line.size();
+}
 
+static void broadcastNumbersToWorkers() {
+  long long num;
+  while (readNumber(num)) {
     struct worker& work = workers[getAvailableWorker()];
     numWorkersAvailable--;
     // change the state
@@ -108,11 +126,189 @@ static void waitForAllWorkers() {
   sigprocmask(SIG_UNBLOCK, &mask2, NULL);
 }
 
+/**
+ * Pool mode: the workers run factor.py --framed, which never stops itself.
+ * Each request and response is a frame, a 4-byte big-endian length and
+ * then that many bytes of text.  A request holds a batch of numbers, one
+ * per line.  Its response starts with a line giving the seconds the worker
+ * spent answering the batch, followed by the lines it would otherwise have
+ * printed for the numbers, in the same order.
+ */
+static void writeFully(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) throw SubprocessException(string("Error writing to worker: ") + strerror(errno));
+    buf += n;
+    len -= n;
+  }
+}
+
+static bool readFully(int fd, char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = read(fd, buf, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) throw SubprocessException(string("Error reading from worker: ") + strerror(errno));
+    if (n == 0) return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+static void writeFrame(int fd, const string& payload) {
+  string frame(4, '\0');
+  uint32_t len = htonl(payload.size());
+  memcpy(&frame[0], &len, sizeof(len));
+  frame += payload;
+  writeFully(fd, frame.data(), frame.size());
+}
+
+static string readFrame(int fd) {
+  uint32_t len;
+  string payload;
+  if (readFully(fd, (char *) &len, sizeof(len))) {
+    payload.resize(ntohl(len));
+    if (readFully(fd, &payload[0], payload.size())) return payload;
+  }
+  throw SubprocessException("A worker exited before answering.");
+}
+
+/**
+ * Batch sizes adapt so the fixed cost of a dispatch stays a small share of
+ * each batch.  That cost (the pipe round trip and waking the worker) is
+ * measured on the first kCalibrationBatches single-number batches, as the
+ * smallest round trip less the service time the worker reports; larger
+ * round trips include waiting for a CPU.  A worker's first round trip also
+ * covers starting the interpreter, so it isn't counted.  The service time
+ * per number is smoothed over every batch.  Once calibrated, batches double
+ * while a batch's service time is under kGrowRatio dispatch costs, and
+ * halve once it's over kShrinkRatio of them; larger batches would only hold
+ * up the answers behind them and unbalance the workers.
+ */
+static const size_t kCalibrationBatches = 8;
+static const double kGrowRatio = 10;
+static const double kShrinkRatio = 40;
+static const double kSmoothing = 0.125;
+static const size_t kMaxBatchSize = 4096;
+
+struct batchSizer {
+  size_t size = 1;
+  size_t numSamples = 0;         // single-number round trips measured
+  double dispatchCost = 0;       // seconds per batch
+  double serviceTime = 0;        // seconds per number
+};
+
+static void adjustBatchSize(batchSizer& sizer, worker& w, double serviceTime) {
+  if (!w.started) {
+    w.started = true;
+    return;
+  }
+  double perNumber = serviceTime / w.batchSize;
+  if (sizer.numSamples < kCalibrationBatches) {
+    if (w.batchSize != 1) return;
+    double roundTrip = chrono::duration<double>(chrono::steady_clock::now() - w.sent).count();
+    double dispatchCost = max(roundTrip - serviceTime, 0.0);
+    sizer.dispatchCost = (sizer.numSamples == 0) ? dispatchCost : min(sizer.dispatchCost, dispatchCost);
+    sizer.serviceTime = (sizer.numSamples == 0) ? perNumber : sizer.serviceTime + kSmoothing * (perNumber - sizer.serviceTime);
+    sizer.numSamples++;
+    return;
+  }
+  sizer.serviceTime += kSmoothing * (perNumber - sizer.serviceTime);
+
+  double batchTime = sizer.serviceTime * sizer.size;
+  if (batchTime < kGrowRatio * sizer.dispatchCost && w.batchSize == sizer.size && sizer.size < kMaxBatchSize) {
+    sizer.size *= 2;
+  } else if (batchTime > kShrinkRatio * sizer.dispatchCost && sizer.size > 1) {
+    sizer.size /= 2;
+  }
+}
+
+/**
+ * Reads a worker's response, returning the answer lines and storing the
+ * service time it reported in serviceTime.
+ */
+static string readResponse(const worker& w, double& serviceTime) {
+  string payload = readFrame(w.sp.ingestfd);
+  size_t endpos = payload.find('\n');
+  if (endpos == string::npos) throw SubprocessException("A worker sent a malformed response.");
+  serviceTime = stod(payload.substr(0, endpos));
+  return payload.substr(endpos + 1);
+}
+
+/**
+ * Hands batches of numbers to idle workers and waits in epoll for whichever
+ * worker answers first.  Answers are printed in input order, so each batch's
+ * answers are held until those of all earlier batches have been printed.
+ */
+static void runWorkerPool() {
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) throw SubprocessException(string("Error creating epoll instance: ") + strerror(errno));
+  vector<size_t> idle;
+  for (size_t i = 0; i < workers.size(); i++) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = i;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, workers[i].sp.ingestfd, &event) < 0) {
+      close(epfd);
+      throw SubprocessException(string("Error watching worker: ") + strerror(errno));
+    }
+    idle.push_back(i);
+  }
+
+  map<size_t, string> answered;
+  size_t numBatches = 0;
+  size_t numPrinted = 0;
+  batchSizer sizer;
+  bool moreInput = true;
+  vector<struct epoll_event> events(workers.size());
+  while (true) {
+    while (moreInput && !idle.empty()) {
+      string request;
+      size_t numNumbers = 0;
+      long long num;
+      while (numNumbers < sizer.size && (moreInput = readNumber(num))) {
+        if (numNumbers > 0) request += '\n';
+        request += to_string(num);
+        numNumbers++;
+      }
+      if (numNumbers == 0) break;
+      worker& w = workers[idle.back()];
+      idle.pop_back();
+      w.batch = numBatches++;
+      w.batchSize = numNumbers;
+      w.sent = chrono::steady_clock::now();
+      writeFrame(w.sp.supplyfd, request);
+    }
+    if (idle.size() == workers.size()) break;
+
+    int numEvents = epoll_wait(epfd, events.data(), events.size(), -1);
+    if (numEvents < 0 && errno == EINTR) continue;
+    if (numEvents < 0) {
+      close(epfd);
+      throw SubprocessException(string("Error waiting for workers: ") + strerror(errno));
+    }
+    for (int e = 0; e < numEvents; e++) {
+      size_t i = events[e].data.u64;
+      double serviceTime;
+      answered[workers[i].batch] = readResponse(workers[i], serviceTime);
+      adjustBatchSize(sizer, workers[i], serviceTime);
+      idle.push_back(i);
+    }
+    for (auto it = answered.begin(); it != answered.end() && it->first == numPrinted; it = answered.erase(it)) {
+      cout << it->second << endl;
+      numPrinted++;
+    }
+  }
+  close(epfd);
+}
+
 static void closeAllWorkers() {
   signal(SIGCHLD, SIG_DFL);
   for (worker& w: workers) {
     kill(w.sp.pid, SIGCONT);
     assert(close(w.sp.supplyfd) == 0);
+    if (w.sp.ingestfd != kNotInUse) close(w.sp.ingestfd);
   }
 
   for (worker& w: workers) {
@@ -121,11 +317,20 @@ static void closeAllWorkers() {
 }
 
 int main(int argc, char *argv[]) {
+  // --pool keeps the workers running and exchanges framed requests and
+  // responses with them over pipes, instead of stopping and continuing them.
+  bool pool = argc > 1 && string(argv[1]) == "--pool";
   try {
-    signal(SIGCHLD, markWorkersAsAvailable);
-    spawnAllWorkers();
-    broadcastNumbersToWorkers();
-    waitForAllWorkers();
+    if (pool) {
+      signal(SIGPIPE, SIG_IGN);  // a worker that dies surfaces as a write error
+      spawnAllWorkers(true);
+      runWorkerPool();
+    } else {
+      signal(SIGCHLD, markWorkersAsAvailable);
+      spawnAllWorkers(false);
+      broadcastNumbersToWorkers();
+      waitForAllWorkers();
+    }
     closeAllWorkers();
     return 0;
   } catch (const SubprocessException& se) {
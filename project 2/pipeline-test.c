@@ -47,7 +47,48 @@ static void simpleTest() {
   launchPipedExecutables(argv1, argv2);
 }
 
+static void multiStageTest() {
+  char *argv1[] = {"cat", "/usr/include/tar.h", NULL};
+  char *argv2[] = {"grep", "define", NULL};
+  char *argv3[] = {"sort", NULL};
+  char *argv4[] = {"uniq", NULL};
+  char *argv5[] = {"wc", NULL};
+  char **argvs[] = {argv1, argv2, argv3, argv4, argv5};
+  size_t n = sizeof(argvs) / sizeof(argvs[0]);
+  printf("Pipeline: ");
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0) printf(" -> ");
+    printArgumentVector(argvs[i]);
+  }
+  printf("\n");
+  fflush(stdout);
+
+  struct pipeline_options options = {PIPELINE_PGROUP, 0, 1 << 20};
+  pid_t pids[n];
+  if (pipeline_n(argvs, n, pids, &options) < 0) {
+    perror("pipeline_n");
+    return;
+  }
+  for (size_t i = 0; i < n; i++) waitpid(pids[i], NULL, 0);
+}
+
+static void failureTest() {
+  char *argv1[] = {"cat", "/usr/include/tar.h", NULL};
+  char *argv2[] = {"no-such-program", NULL};
+  char **argvs[] = {argv1, argv2};
+  pid_t pids[2];
+  if (pipeline_n(argvs, 2, pids, NULL) < 0) {
+    printf("Pipeline: cat -> no-such-program failed as expected\n");
+    return;
+  }
+  printf("FAILED: pipeline_n launched cat -> no-such-program\n");
+  waitpid(pids[0], NULL, 0);
+  waitpid(pids[1], NULL, 0);
+}
+
 int main(int argc, char *argv[]) {
   simpleTest();
+  multiStageTest();
+  failureTest();
   return 0;
 }
@@ -1,44 +1,96 @@
 /**
  * File: pipeline.c
  * ----------------
- * Presents the implementation of the pipeline routine.
+ * Presents the implementation of the pipeline routines.
  */
 
+#define _GNU_SOURCE  // pipe2, F_SETPIPE_SZ
 #include "pipeline.h"
 #include <stdio.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <signal.h>
+#include <sys/wait.h>
 
-void pipeline(char *argv1[], char *argv2[], pid_t pids[]) {
-  int fds[2];
-  pipe(fds);
-  pid_t read_child = fork();
-  // Error checking
-  if (read_child == -1) {
-    printf("Error in creating read_child process.\n");
-    return;
-  }
-  if (!read_child) {
-    close(fds[1]);
-    dup2(fds[0], STDIN_FILENO);
-    close(fds[0]);
-    execvp(argv2[0], argv2);
+extern char **environ;
+
+// Kills and reaps the first n stages, leaving errno as it was.
+static void abandonStages(pid_t pids[], size_t n) {
+  int savedErrno = errno;
+  for (size_t i = 0; i < n; i++) kill(pids[i], SIGKILL);
+  for (size_t i = 0; i < n; i++) waitpid(pids[i], NULL, 0);
+  errno = savedErrno;
+}
+
+/**
+ * Spawns argv with in and out (when not -1) as its standard input and
+ * output.  Returns 0 on success, or an errno value.
+ */
+static int spawnStage(char *argv[], int in, int out, pid_t pgid, bool setpgroup, pid_t *pid) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  int err = posix_spawn_file_actions_init(&actions);
+  if (err != 0) return err;
+  err = posix_spawnattr_init(&attr);
+  if (err != 0) {
+    posix_spawn_file_actions_destroy(&actions);
+    return err;
   }
-  pids[1] = read_child;
-  close(fds[0]);
-
-  // Error checking
-  pid_t write_child = fork();
-  if (write_child == -1) {
-    printf("Error in creating write_child process.\n");
-    return;
+  if (in != -1) err = posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+  if (err == 0 && out != -1) err = posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+  if (err == 0 && setpgroup) {
+    err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    if (err == 0) err = posix_spawnattr_setpgroup(&attr, pgid);
   }
+  if (err == 0) err = posix_spawnp(pid, argv[0], &actions, &attr, argv, environ);
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  return err;
+}
+
+int pipeline_n(char **argvs[], size_t n, pid_t pids[], const struct pipeline_options *options) {
+  struct pipeline_options defaults = {0, 0, 0};
+  if (options == NULL) options = &defaults;
+  bool setpgroup = (options->flags & PIPELINE_PGROUP) != 0;
+  pid_t pgid = options->pgid;
+
+  int in = -1;  // read end of the pipe feeding the next stage
+  for (size_t i = 0; i < n; i++) {
+    int fds[2] = {-1, -1};
+    if (i < n - 1) {
+      if (pipe2(fds, O_CLOEXEC) < 0 ||
+          (options->pipeSize > 0 && fcntl(fds[0], F_SETPIPE_SZ, options->pipeSize) < 0)) {
+        int err = errno;
+        if (fds[0] != -1) {
+          close(fds[0]);
+          close(fds[1]);
+        }
+        if (in != -1) close(in);
+        errno = err;
+        abandonStages(pids, i);
+        return -1;
+      }
+    }
 
-  if (!write_child) {
-    close(fds[0]);
-    dup2(fds[1], STDOUT_FILENO);
-    close(fds[1]);
-    execvp(argv1[0], argv1);
+    int err = spawnStage(argvs[i], in, fds[1], pgid, setpgroup, &pids[i]);
+    if (in != -1) close(in);
+    if (fds[1] != -1) close(fds[1]);
+    in = fds[0];
+    if (err != 0) {
+      if (in != -1) close(in);
+      errno = err;
+      abandonStages(pids, i);
+      return -1;
+    }
+    // Later stages join the group the first one leads.
+    if (setpgroup && pgid == 0) pgid = pids[0];
   }
-  close(fds[1]);
-  pids[0] = write_child;
+  return 0;
+}
+
+void pipeline(char *argv1[], char *argv2[], pid_t pids[]) {
+  char **argvs[] = {argv1, argv2};
+  if (pipeline_n(argvs, 2, pids, NULL) < 0) perror("pipeline");
 }
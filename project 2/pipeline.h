@@ -23,6 +23,7 @@
 #ifndef _pipeline_h_
 #define _pipeline_h_
 
+#include <stddef.h>
 #include <unistd.h>
 
 /**
@@ -38,4 +39,39 @@
 
 void pipeline(char *argv1[], char *argv2[], pid_t pids[]);
 
+/**
+ * Flags for pipeline_options.
+ *
+ *   PIPELINE_PGROUP  places every stage in the process group pgid, or in a
+ *                    new group led by the first stage if pgid is 0, so the
+ *                    whole chain can be signaled or waited on as one job.
+ */
+#define PIPELINE_PGROUP 0x1
+
+struct pipeline_options {
+  int flags;
+  pid_t pgid;       // with PIPELINE_PGROUP, the group to join (0 for a new one)
+  int pipeSize;     // if positive, each pipe's capacity in bytes (F_SETPIPE_SZ)
+};
+
+/**
+ * Function: pipeline_n
+ * --------------------
+ * Spawns off n sister processes, the ith around the argument vector
+ * argvs[i], and places the process id of each in pids[i].  The standard
+ * output of each process is piped to the standard input of the next; the
+ * first reads the caller's standard input and the last writes the
+ * caller's standard output.  options may be NULL for the defaults.
+ *
+ * The pipes are created close-on-exec, so no stage holds any pipe end
+ * other than its own stdin and stdout, and none leak into processes the
+ * caller launches later.  A pipeSize above /proc/sys/fs/pipe-max-size is
+ * an error (EPERM) for unprivileged callers.
+ *
+ * Returns 0 on success.  If any pipe can't be made or sized, or any stage
+ * can't be spawned or executed, the stages already running are killed
+ * and reaped, and pipeline_n returns -1 with errno describing the failure.
+ */
+int pipeline_n(char **argvs[], size_t n, pid_t pids[], const struct pipeline_options *options);
+
 #endif
@@ -0,0 +1,151 @@
+/**
+ * File: subprocess-relay.cc
+ * -------------------------
+ * Presents the implementation of the subprocess_relay and
+ * subprocess_fanout routines.
+ *
+ * A fanout can't tee straight from the source pipe into the targets: tee
+ * always copies from the front of the source, so a target with room for
+ * only part of a chunk could never be sent the rest of it.  Instead each
+ * target gets a private staging pipe at least as large as the source.
+ * Every chunk is teed into all of the staging pipes (spliced into the
+ * last, which consumes it from the source), and since they're empty and
+ * big enough, each receives the whole chunk.  The staging pipes are then
+ * spliced into the targets as each target has room, and the next chunk
+ * is read once they have all drained.
+ */
+
+#include "subprocess.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+using namespace std;
+
+static const size_t kMaxChunk = 1 << 20;
+
+static void throwError(const string& what, int err) throw (SubprocessException) {
+  throw SubprocessException(what + ": " + strerror(err));
+}
+
+static void checkInUse(int fd, const char *name) throw (SubprocessException) {
+  if (fd == kNotInUse) throw SubprocessException(string("Relay needs a ") + name + " that's in use.");
+}
+
+/**
+ * Moves up to len bytes between pipes, retrying when interrupted.
+ * Returns the number of bytes moved, 0 at end of file, and -1 with
+ * errno set on error.
+ */
+static ssize_t spliceSome(int in, int out, size_t len, unsigned int flags) {
+  while (true) {
+    ssize_t n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE | flags);
+    if (n >= 0 || errno != EINTR) return n;
+  }
+}
+
+static ssize_t teeSome(int in, int out, size_t len) {
+  while (true) {
+    ssize_t n = tee(in, out, len, 0);
+    if (n >= 0 || errno != EINTR) return n;
+  }
+}
+
+size_t subprocess_relay(const subprocess_t& from, const subprocess_t& to) throw (SubprocessException) {
+  checkInUse(from.ingestfd, "source ingestfd");
+  checkInUse(to.supplyfd, "target supplyfd");
+  size_t total = 0;
+  while (true) {
+    ssize_t n = spliceSome(from.ingestfd, to.supplyfd, kMaxChunk, 0);
+    if (n < 0) throwError("Error relaying output", errno);
+    if (n == 0) return total;
+    total += n;
+  }
+}
+
+/**
+ * Splices each staging pipe's pending bytes into its target, waiting on
+ * whichever targets have room, until every staging pipe is empty.
+ */
+static void drainStaging(const vector<int>& staging, const vector<subprocess_t>& to,
+                         vector<size_t>& pending) throw (SubprocessException) {
+  vector<struct pollfd> fds(to.size());
+  while (true) {
+    size_t numWaiting = 0;
+    for (size_t i = 0; i < to.size(); i++) {
+      fds[i].fd = (pending[i] > 0) ? to[i].supplyfd : -1;  // poll skips negative fds
+      fds[i].events = POLLOUT;
+      fds[i].revents = 0;
+      if (pending[i] > 0) numWaiting++;
+    }
+    if (numWaiting == 0) return;
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      throwError("Error waiting on relay targets", errno);
+    }
+
+    for (size_t i = 0; i < to.size(); i++) {
+      if (fds[i].revents == 0) continue;
+      ssize_t n = spliceSome(staging[i], to[i].supplyfd, pending[i], SPLICE_F_NONBLOCK);
+      if (n < 0 && errno == EAGAIN) continue;
+      if (n <= 0) throwError("Error relaying output", (n < 0) ? errno : EPIPE);
+      pending[i] -= n;
+    }
+  }
+}
+
+size_t subprocess_fanout(const subprocess_t& from, const vector<subprocess_t>& to) throw (SubprocessException) {
+  checkInUse(from.ingestfd, "source ingestfd");
+  for (const subprocess_t& sp: to) checkInUse(sp.supplyfd, "target supplyfd");
+  if (to.empty()) throw SubprocessException("Relay needs at least one target.");
+  if (to.size() == 1) return subprocess_relay(from, to[0]);
+
+  int sourceSize = fcntl(from.ingestfd, F_GETPIPE_SZ);
+  if (sourceSize < 0) throwError("Error sizing relay source", errno);
+  vector<int> staging;
+  try {
+    for (size_t i = 0; i < to.size(); i++) {
+      int fds[2];
+      if (pipe2(fds, O_CLOEXEC) < 0) throwError("Error creating pipe", errno);
+      staging.push_back(fds[0]);
+      staging.push_back(fds[1]);
+      if (fcntl(fds[0], F_GETPIPE_SZ) < sourceSize && fcntl(fds[0], F_SETPIPE_SZ, sourceSize) < 0) {
+        throwError("Error sizing relay pipe", errno);
+      }
+    }
+  } catch (const SubprocessException&) {
+    for (int fd: staging) close(fd);
+    throw;
+  }
+  vector<int> stagingIn, stagingOut;
+  for (size_t i = 0; i < staging.size(); i += 2) {
+    stagingOut.push_back(staging[i]);
+    stagingIn.push_back(staging[i + 1]);
+  }
+
+  size_t total = 0;
+  vector<size_t> pending(to.size(), 0);
+  try {
+    while (true) {
+      // Blocks until the source has output, and copies all of it.
+      ssize_t chunk = teeSome(from.ingestfd, stagingIn[0], kMaxChunk);
+      if (chunk < 0) throwError("Error copying output", errno);
+      if (chunk == 0) break;
+      for (size_t i = 1; i < to.size(); i++) {
+        ssize_t n = (i < to.size() - 1) ? teeSome(from.ingestfd, stagingIn[i], chunk)
+                                        : spliceSome(from.ingestfd, stagingIn[i], chunk, 0);
+        if (n < 0) throwError("Error copying output", errno);
+        if (n != chunk) throw SubprocessException("Relay staging pipe took only part of a chunk.");
+      }
+      for (size_t i = 0; i < to.size(); i++) pending[i] = chunk;
+      total += chunk;
+      drainStaging(stagingOut, to, pending);
+    }
+  } catch (const SubprocessException&) {
+    for (int fd: staging) close(fd);
+    throw;
+  }
+  for (int fd: staging) close(fd);
+  return total;
+}
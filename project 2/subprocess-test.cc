@@ -0,0 +1,135 @@
+/**
+ * File: subprocess-test.cc
+ * ------------------------
+ * Exercises the subprocess relays to verify that they move
+ * streams intact, keep up with slow readers, and report
+ * readers that go away.
+ */
+
+#include "subprocess.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <signal.h>
+#include <fcntl.h>
+using namespace std;
+
+static const size_t kStreamSize = 64 << 20;
+
+/**
+ * Writes kStreamSize bytes of a pattern that never repeats within a
+ * pipe's capacity to a new temporary file, so a dropped, repeated or
+ * reordered chunk shows up in cmp.
+ */
+static string makeStreamFile() {
+  char path[] = "/tmp/subprocess-test-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) return "";
+  vector<char> buf(1 << 20);
+  for (size_t done = 0; done < kStreamSize; done += buf.size()) {
+    for (size_t i = 0; i < buf.size(); i += sizeof(uint32_t)) {
+      uint32_t word = (done + i) * 2654435761u;
+      memcpy(&buf[i], &word, sizeof(word));
+    }
+    if (write(fd, buf.data(), buf.size()) != (ssize_t) buf.size()) {
+      close(fd);
+      unlink(path);
+      return "";
+    }
+  }
+  close(fd);
+  return path;
+}
+
+static subprocess_t launch(const vector<string>& args, bool supplyChildInput, bool ingestChildOutput) {
+  vector<char *> argv;
+  for (const string& arg: args) argv.push_back(const_cast<char *>(arg.c_str()));
+  argv.push_back(NULL);
+  return subprocess(argv.data(), supplyChildInput, ingestChildOutput);
+}
+
+static bool exitedCleanly(pid_t pid) {
+  int status;
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void report(const string& test, bool passed) {
+  cout << test << ": " << (passed ? "ok" : "FAILED") << endl;
+}
+
+static void largeRelayTest(const string& path) {
+  subprocess_t from = launch({"cat", path}, false, true);
+  subprocess_t to = launch({"cmp", "-", path}, true, false);
+  size_t moved = subprocess_relay(from, to);
+  close(to.supplyfd);
+  close(from.ingestfd);
+  bool sourceDone = exitedCleanly(from.pid);
+  bool matched = exitedCleanly(to.pid);
+  report("Relay: cat -> cmp", moved == kStreamSize && sourceDone && matched);
+}
+
+static void fanoutTest(const string& path) {
+  subprocess_t from = launch({"cat", path}, false, true);
+  vector<subprocess_t> to = {
+    launch({"cmp", "-", path}, true, false),
+    launch({"sh", "-c", "sleep 1; exec cmp - \"$0\"", path}, true, false),  // the slow reader
+    launch({"cmp", "-", path}, true, false),
+    launch({"cmp", "-", path}, true, false),
+  };
+  size_t moved = subprocess_fanout(from, to);
+  bool passed = moved == kStreamSize;
+  for (const subprocess_t& sp: to) close(sp.supplyfd);
+  for (const subprocess_t& sp: to) passed = exitedCleanly(sp.pid) && passed;
+  close(from.ingestfd);
+  passed = exitedCleanly(from.pid) && passed;
+  report("Fanout: cat -> 4 x cmp, one slow", passed);
+}
+
+static void earlyExitTest(const string& path) {
+  subprocess_t from = launch({"cat", path}, false, true);
+  vector<subprocess_t> to = {
+    launch({"sh", "-c", "exec cat > /dev/null"}, true, false),
+    launch({"head", "-c", "10"}, true, true),  // exits after 10 bytes
+  };
+  bool raised = false;
+  try {
+    subprocess_fanout(from, to);
+  } catch (const SubprocessException& se) {
+    raised = strstr(se.what(), strerror(EPIPE)) != NULL;
+  }
+  for (const subprocess_t& sp: to) {
+    close(sp.supplyfd);
+    if (sp.ingestfd != kNotInUse) close(sp.ingestfd);
+    waitpid(sp.pid, NULL, 0);
+  }
+  close(from.ingestfd);
+  waitpid(from.pid, NULL, 0);
+  report("Fanout: cat -> head -c 10 raises EPIPE", raised);
+}
+
+static void ignoreSignal(int sig) {}
+
+int main(int argc, char *argv[]) {
+  // A reader that goes away must surface as EPIPE, not kill the test.  A
+  // handler rather than SIG_IGN, since the children get the default back
+  // on exec and then go quietly when their own readers go away.
+  signal(SIGPIPE, ignoreSignal);
+  string path = makeStreamFile();
+  if (path.empty()) {
+    cerr << "Can't create the test stream." << endl;
+    return 1;
+  }
+  try {
+    largeRelayTest(path);
+    fanoutTest(path);
+    earlyExitTest(path);
+  } catch (const SubprocessException& se) {
+    cerr << "Unexpected failure: " << se.what() << endl;
+    unlink(path.c_str());
+    return 1;
+  }
+  unlink(path.c_str());
+  return 0;
+}
@@ -5,58 +5,65 @@
  */
 
 #include "subprocess.h"
+#include <spawn.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
 using namespace std;
 
-subprocess_t subprocess(char *argv[], bool supplyChildInput, bool ingestChildOutput) throw (SubprocessException) {
-	
-	int supplyChildInput_fds[2];
-	int ingestChildOutput_fds[2];
-	int supplyfd = kNotInUse;
-	int ingestfd = kNotInUse;
-
-	if (supplyChildInput) {
-		pipe(supplyChildInput_fds);
-  		supplyfd = supplyChildInput_fds[1];
-	}
-	if (ingestChildOutput) {
-		pipe(ingestChildOutput_fds);
-    	ingestfd = ingestChildOutput_fds[0];
-  	}
-
-  	pid_t pid = fork();
-  	// Error checking
-  	if (pid < 0){
-    	throw SubprocessException("Error in forking child process.");
-  	}
-
-  	subprocess_t sp =  {pid, supplyfd, ingestfd};
-  	
-  	// In child process
-  	if (sp.pid == 0){
-    	if (supplyChildInput){
-      		close(supplyChildInput_fds[1]);
-      		// Using dup2 and close to redirect the read end to stdin
-      		dup2(supplyChildInput_fds[0], 0);
-      		close(supplyChildInput_fds[0]);
-    	}
-    	if (ingestChildOutput){
-      		close(ingestChildOutput_fds[0]);
-      		// Using dup2 and close to redirect the write end to stdout
-      		dup2(ingestChildOutput_fds[1], 1);
-      		close(ingestChildOutput_fds[1]);
-    	}
-    	execvp(argv[0], argv);
-    	// Error checking
-    	throw SubprocessException("Error in executing execp.");
-  	}
-
-  	if (supplyChildInput){
-    	close(supplyChildInput_fds[0]);
-  	}
-  	if (ingestChildOutput){
-    	close(ingestChildOutput_fds[1]);
-  	}
-  	return sp;
+extern char **environ;
+
+static void closeIfInUse(int fd) {
+  if (fd != kNotInUse) close(fd);
+}
+
+/**
+ * Creates a pipe whose ends are both close-on-exec, so the parent's end
+ * never leaks into this child or any later one.  The child's end stops
+ * being close-on-exec when it's dup2'ed onto the child's stdin or stdout.
+ */
+static void makePipe(int fds[]) throw (SubprocessException) {
+  if (pipe2(fds, O_CLOEXEC) < 0) {
+    throw SubprocessException(string("Error creating pipe: ") + strerror(errno));
+  }
 }
 
-	
+subprocess_t subprocess(char *argv[], bool supplyChildInput, bool ingestChildOutput) throw (SubprocessException) {
+  int supplyfds[2] = {kNotInUse, kNotInUse};
+  int ingestfds[2] = {kNotInUse, kNotInUse};
+  if (supplyChildInput) makePipe(supplyfds);
+  if (ingestChildOutput) {
+    try {
+      makePipe(ingestfds);
+    } catch (const SubprocessException&) {
+      closeIfInUse(supplyfds[0]);
+      closeIfInUse(supplyfds[1]);
+      throw;
+    }
+  }
+
+  // The file actions replay the dup2 calls the child used to make after
+  // fork.  The parent's ends are close-on-exec, so they need no action.
+  posix_spawn_file_actions_t actions;
+  int err = posix_spawn_file_actions_init(&actions);
+  if (err == 0 && supplyChildInput) err = posix_spawn_file_actions_adddup2(&actions, supplyfds[0], STDIN_FILENO);
+  if (err == 0 && ingestChildOutput) err = posix_spawn_file_actions_adddup2(&actions, ingestfds[1], STDOUT_FILENO);
+
+  // posix_spawnp shares the parent's memory until the exec, and an exec
+  // failure comes back here as its return value, never in the child.
+  pid_t pid = kNotInUse;
+  if (err == 0) err = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+
+  closeIfInUse(supplyfds[0]);
+  closeIfInUse(ingestfds[1]);
+  if (err != 0) {
+    closeIfInUse(supplyfds[1]);
+    closeIfInUse(ingestfds[0]);
+    throw SubprocessException(string("Error executing ") + argv[0] + ": " + strerror(err));
+  }
+
+  subprocess_t sp = {pid, supplyfds[1], ingestfds[0]};
+  return sp;
+}
@@ -0,0 +1,67 @@
+/**
+ * File: subprocess.h
+ * ------------------
+ * Exports a custom data type to bundle everything needed to spawn a
+ * new process and communicate with it through pipes.
+ */
+
+#pragma once
+#include <unistd.h>
+#include <sys/wait.h>
+#include <vector>
+#include "subprocess-exception.h"
+
+static const int kNotInUse = -1;
+struct subprocess_t {
+  pid_t pid;
+  int supplyfd;
+  int ingestfd;
+};
+
+/**
+ * Function: subprocess
+ * --------------------
+ * Launches the program named by argv[0] (searched for along the PATH) with
+ * argv as its arguments.  If supplyChildInput is true, the child's standard
+ * input is the read end of a pipe whose write end is returned as supplyfd;
+ * otherwise supplyfd is kNotInUse and the child shares the parent's
+ * standard input.  Likewise, if ingestChildOutput is true, the child's
+ * standard output feeds a pipe whose read end is returned as ingestfd.
+ *
+ * The child is launched with posix_spawnp rather than fork, so the cost of
+ * a launch doesn't grow with the parent's address space.  The returned
+ * descriptors are close-on-exec, so they never leak into later children.
+ *
+ * Throws a SubprocessException in the parent if the pipes can't be made or
+ * the program can't be executed (for example, because it doesn't exist),
+ * in which case no child is left behind and no descriptors are leaked.
+ */
+subprocess_t subprocess(char *argv[], bool supplyChildInput, bool ingestChildOutput) throw (SubprocessException);
+
+/**
+ * Function: subprocess_relay
+ * --------------------------
+ * Feeds everything from writes to its standard output into the standard
+ * input of to, until from's output reaches end of file, and returns the
+ * number of bytes moved.  The bytes are moved between the two pipes with
+ * splice(2), so they are never copied into user space.  from must have
+ * been launched with ingestChildOutput and to with supplyChildInput.
+ * Neither descriptor is closed; the caller closes to.supplyfd afterward
+ * to signal end of file to to.
+ *
+ * Throws a SubprocessException if a descriptor isn't in use or a splice
+ * fails, for example because to exited (EPIPE, if SIGPIPE is ignored).
+ */
+size_t subprocess_relay(const subprocess_t& from, const subprocess_t& to) throw (SubprocessException);
+
+/**
+ * Function: subprocess_fanout
+ * ---------------------------
+ * Like subprocess_relay, but delivers a copy of from's output to the
+ * standard input of every process in to.  The copies are made with tee(2),
+ * again without the bytes passing through user space, and each chunk of
+ * output is delivered to all of the processes before the next is read, so
+ * the stream advances at the pace of the slowest reader.  Returns the
+ * number of bytes read from from.
+ */
+size_t subprocess_fanout(const subprocess_t& from, const std::vector<subprocess_t>& to) throw (SubprocessException);